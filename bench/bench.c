@@ -0,0 +1,73 @@
+//Measures the cost of the library's basic operations,
+// built against both libsljex and libsljex-checked by make bench
+//usage: bench [label]
+
+#include "../sljex.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#define ITERATIONS 10000000L
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(char const * label, char const * name, double start) {
+    printf("%-8s %-24s %8.2f ns/op\n", label, name, (now() - start) / ITERATIONS);
+}
+
+static void thrower(void) {
+    throw(EXGENERIC);
+}
+
+int main(int argc, char * * argv) {
+    char const * label = argc > 1 ? argv[1] : "";
+    if(!sljex_init()){
+        return 1;
+    }
+    
+    double start = now();
+    for(long i = 0; i < ITERATIONS; i++){
+        try{
+        }finally;
+    }
+    report(label, "try/finally", start);
+    
+    start = now();
+    for(long i = 0; i < ITERATIONS; i++){
+        try{
+            thrower();
+        }catch(EXGENERIC){
+        }finally;
+    }
+    report(label, "throw/catch", start);
+    
+    start = now();
+    for(long i = 0; i < ITERATIONS; i++){
+        try{
+            thrower();
+        }catchany{
+            (void)sljex_excode();
+            (void)sljex_exstr();
+        }finally;
+    }
+    report(label, "throw/catchany/excode", start);
+    
+    start = now();
+    for(long i = 0; i < ITERATIONS; i++){
+        try{
+            try{
+                thrower();
+            }catchany{
+                rethrow;
+            }finally;
+        }catchany{
+        }finally;
+    }
+    report(label, "throw/rethrow/catch", start);
+    
+    return 0;
+}
@@ -0,0 +1,75 @@
+//Deadline and cancellation scopes around work that has its own try blocks,
+// the scope exceptions pass through those try blocks, which release what they hold
+
+#include "../sljex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define EXPARSE (EXGENERIC + 1)
+
+void work(size_t i);//throws EXPARSE, checks for timeout and cancellation
+
+static size_t leaked;//buffers of work that were never freed
+
+void * canceller(void * token) {
+    struct timespec const delay = {0, 10 * 1000000L};//10ms
+    nanosleep(&delay, NULL);
+    sljex_cancel_request(token);
+    return NULL;
+}
+
+//runs work until it is cancelled or times out
+void run(sljex_cancel * token, unsigned long long ns) {
+    sljex_deadline(ns){
+        sljex_cancel_scope(token){
+            for(size_t i = 0; ; i++){
+                work(i);
+            }
+        }catch(EXCANCELLED){
+            puts("cancelled");
+        }catchany{
+            //EXTIMEOUT belongs to the deadline scope
+            rethrow;
+        }finally;
+    }catch(EXTIMEOUT){
+        puts("timed out");
+    }finally;
+}
+
+int main(void) {
+    sljex_cancel token = SLJEX_CANCEL_INIT;
+
+    //times out after 5ms, before anyone cancels
+    run(&token, 5 * 1000000ull);
+
+    //cancelled from another thread after 10ms, before the 1s deadline
+    pthread_t thread;
+    pthread_create(&thread, NULL, canceller, &token);
+    run(&token, 1000 * 1000000ull);
+    pthread_join(thread, NULL);
+
+    printf("%zu buffers leaked\n", leaked);
+}
+
+void work(size_t i) {
+    char * buffer = malloc(64);
+    leaked++;
+    //this try block handles EXPARSE itself,
+    // EXTIMEOUT and EXCANCELLED are passed on to their scopes
+    try{
+        sljex_checkpoint();
+        if(i % 1000 == 0){
+            throw(EXPARSE);
+        }
+    }catch(EXPARSE){
+        //skip the item
+    }catchany{
+        free(buffer);
+        leaked--;
+        rethrow;
+    }finally;
+    free(buffer);
+    leaked--;
+}
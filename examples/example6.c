@@ -0,0 +1,83 @@
+//Hardware faults converted into exceptions: an invalid access, a division
+// by zero, a fault from inside a catch block and a stack overflow,
+// and a fault outside of any try passed on to the previous handler
+
+#include "../sljex.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+int divide(int a, int b);//throws EXFPE if b is 0
+int recurse(int n);//throws EXSEGV once the stack overflows
+
+//handler installed before sljex_trap_signals,
+// only reached by faults outside of any try block
+void previous(int sig) {
+    (void)sig;
+    char const message[] = "fault outside try passed to the previous handler\n";
+    write(STDOUT_FILENO, message, sizeof(message) - 1);
+    _exit(0);
+}
+
+int main(void) {
+    signal(SIGSEGV, previous);
+    if(!sljex_trap_signals(SLJEX_TRAP_SEGV | SLJEX_TRAP_FPE)){
+        return 1;
+    }
+
+    int volatile * volatile invalid = NULL;
+    try{
+        *invalid = 1;
+    }catch(EXSEGV){
+        printf("caught EXSEGV at %p\n", sljex_exaddr());
+    }finally;
+
+    try{
+        printf("result is: %d\n", divide(7, 0));
+    }catch(EXFPE){
+        puts("caught EXFPE");
+    }finally;
+
+    //a fault inside a catch block goes to the enclosing try,
+    // like a throw from there would
+    try{
+        try{
+            throw(EXGENERIC);
+        }catchany{
+            *invalid = 2;
+        }finally;
+    }catch(EXSEGV){
+        puts("caught EXSEGV from inside a catch block");
+    }finally;
+
+    //the handler runs on an alternate stack,
+    // so running out of stack is trapped as well
+    try{
+        printf("result is: %d\n", recurse(0));
+    }catch(EXSEGV){
+        puts("caught stack overflow");
+    }finally;
+
+    //ends the program through the previous handler,
+    // which cannot flush stdout
+    fflush(stdout);
+    *invalid = 3;
+    return 1;
+}
+
+int divide(int a, int b) {
+    int volatile divisor = b;
+    return a / divisor;
+}
+
+int recurse(int n) {
+    char volatile frame[256];
+    memset((char *)frame, n, sizeof(frame));
+    //never true, the stack overflows long before n wraps around
+    if(n < 0){
+        return 0;
+    }
+    return recurse(n + 1) + frame[n % sizeof(frame)];
+}
@@ -0,0 +1,49 @@
+//Parses a batch of rows with sljex_collect, recording the rows that fail
+// instead of stopping at the first one, then throws EXCOLLECTED at the end
+
+#include "../sljex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define EXPARSE (EXGENERIC + 1)
+
+int parse(char const * row);//throws EXPARSE
+int parse_all(char const * const * rows, size_t count, sljex_collector * collector);
+
+int main(void) {
+    char const * rows[] = {"12", "7", "x", "30", "", "1"};
+
+    sljex_collected errors[4];
+    sljex_collector collector;
+    sljex_collector_init(&collector, errors, 4, true);
+
+    int const sum = parse_all(rows, sizeof(rows) / sizeof(rows[0]), &collector);
+    for(size_t i = 0; i < collector.count && i < 4; i++){
+        printf("row %zu: %s\n", errors[i].index, errors[i].exstr);
+    }
+    printf("sum of the other rows is: %d\n", sum);
+}
+
+//sums the rows that parse
+int parse_all(char const * const * rows, size_t count, sljex_collector * collector) {
+    //modified by the loop, which runs after a single setjmp
+    int volatile sum = 0;
+    try{
+        sljex_collect(collector, i, count){
+            sum += parse(rows[i]);
+        }
+    }catch(EXCOLLECTED){
+        printf("%zu rows failed, the first with \"%s\"\n", (size_t)collector->count, sljex_exstr());
+    }finally;
+    return sum;
+}
+
+int parse(char const * row) {
+    char * end;
+    long const value = strtol(row, &end, 10);
+    if(end == row || *end != '\0'){
+        throwWithMsg(EXPARSE, "not a number");
+    }
+    return (int)value;
+}
@@ -0,0 +1,47 @@
+//Transfers between accounts inside sljex_txn_try, so a transfer that fails
+// halfway leaves both balances as they were before it
+
+#include "../sljex.h"
+
+#include <stdio.h>
+
+#define EXFUNDS (EXGENERIC + 1)
+
+typedef struct account {
+    char const * name;
+    int balance;
+} account;
+
+void transfer(account * from, account * to, int amount);//throws EXFUNDS
+void attempt(account * from, account * to, int amount);
+
+int main(void) {
+    account a = {"a", 100};
+    account b = {"b", 50};
+
+    for(int i = 0; i < 3; i++){
+        attempt(&a, &b, 40);
+        printf("a: %d, b: %d\n", a.balance, b.balance);
+    }
+}
+
+//the accounts are not locals of the function containing the try,
+// so they need not be volatile
+void attempt(account * from, account * to, int amount) {
+    sljex_txn_try{
+        transfer(from, to, amount);
+    }catch(EXFUNDS){
+        //to was already credited, and has been rolled back
+        printf("transfer of %d failed: \"%s\"\n", amount, sljex_exstr());
+    }finally;
+}
+
+void transfer(account * from, account * to, int amount) {
+    int const credited = to->balance + amount;
+    sljex_txn_write(&to->balance, &credited, sizeof(credited));
+    if(from->balance < amount){
+        throwWithMsg(EXFUNDS, "insufficient funds");
+    }
+    sljex_txn_log(&from->balance, sizeof(from->balance));
+    from->balance -= amount;
+}
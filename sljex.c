@@ -10,19 +10,34 @@ This library is distributed in the hope that it will be useful, but WITHOUT ANY
 You should have received a copy of the GNU Lesser General Public License along with this library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA 
 */
 
+//clock_gettime
+#define _XOPEN_SOURCE 700
+
 #include "sljex.h"
 
 #include "vector.h"
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
 
 #include <pthread.h>
+#include <signal.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef SLJEX_ENGINE_UNWIND
+#include <unwind.h>
+#endif
 
 //leverage C11 native support for thread local variables,
 // should be faster than get/setspecific
 #if __STDC_VERSION__ >= 201112L
-#define pthread_key_t _Thread_local vector *
+#define pthread_key_t _Thread_local struct sljex_thread *
 #define pthread_key_create(...) 0
 #define pthread_getspecific(tlv) tlv
 #define pthread_setspecific(tlv, val) (tlv = val, 0)
@@ -32,6 +47,42 @@ You should have received a copy of the GNU Lesser General Public License along w
 ///takes a fmt string and variadics, prints to stderr and calls exit(EXIT_FAILURE)
 #define panic(...) do{fprintf(stderr, __VA_ARGS__);exit(EXIT_FAILURE);}while(0)
 
+//misuse of the library (catch without try, rethrow outside catch, ...)
+// is only detected by the checked build (libsljex-checked),
+// the release build trusts the macros to be used correctly
+#ifdef SLJEX_CHECKED
+///calls misuse with a description of the error if cond is false
+#define check(cond, what) do{if(!(cond)){misuse(what);}}while(0)
+#else
+#define check(cond, what) (void)0
+#endif
+
+//branch hints for the paths only taken by unhandled exceptions
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+//counters shared between threads only need atomicity, not ordering
+#define counter_add(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define counter_load(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define counter_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+
+///attempts at reading a thread's stack before sljex_snapshot_all gives up on it
+#define SLJEX_SNAPSHOT_RETRIES 1000
+
+///size of the alternate signal stack each thread gets while signals are trapped
+#define SLJEX_ALTSTACK_SIZE (64 * 1024)
+
+///minimum size of the blocks sljex_scope_alloc takes memory from
+#define SLJEX_SCOPE_CHUNK 4096
+
+///alignment of sljex_scope_alloc allocations, that of the most aligned basic type,
+/// derived without C11's max_align_t
+#define SLJEX_SCOPE_ALIGN offsetof(sljex_alignprobe, u)
+
+///default number of pops an exception stack spends below
+/// a quarter of its capacity before the capacity is halved
+#define SLJEX_SHRINK_DEFAULT 64
+
 //gcc gives an "error returning array from function"
 // when returning jmp_buf, so void * is used instead
 //this is fine since the jmp_buf is part of a heap
@@ -40,19 +91,54 @@ typedef void * jmp_buf_ptr;
 
 bool sljex_init(void);
 void sljex_deinit(void);
-jmp_buf_ptr sljex_trybuf_(void);
+jmp_buf_ptr sljex_trybuf_(size_t * depth);
+jmp_buf_ptr sljex_deadlinebuf_(size_t * depth, unsigned long long ns);
+jmp_buf_ptr sljex_cancelbuf_(size_t * depth, sljex_cancel * token);
 bool sljex_catch_(int excode);
 bool sljex_catchany_(void);
-jmp_buf_ptr sljex_throwbuf_(int excode, char const * exstr);
-jmp_buf_ptr sljex_rethrowbuf_(void);
-void sljex_finally_(void);
+jmp_buf_ptr sljex_throwbuf_(int excode, char const * exstr, sljex_site * site);
+jmp_buf_ptr sljex_rethrowbuf_(sljex_site * site);
+void sljex_finally_(size_t depth);
 int sljex_excode(void);
 char const * sljex_exstr(void);
+void * sljex_exaddr(void);
+bool sljex_trap_signals(int flags);
+void sljex_collector_init(sljex_collector * c, sljex_collected * errors, size_t cap, bool summary);
+int sljex_collect_begin_(sljex_collector * c);
+jmp_buf_ptr sljex_collectbuf_(sljex_collector * c);
+jmp_buf_ptr sljex_recoverbuf_(size_t * depth);
+jmp_buf_ptr sljex_txnbuf_(size_t * depth);
+void sljex_txn_log(void * ptr, size_t size);
+void sljex_txn_write(void * ptr, void const * value, size_t size);
+sljex_terminate_handler sljex_set_terminate_handler(sljex_terminate_handler handler);
+sljex_terminate_handler sljex_set_thread_terminate_handler(sljex_terminate_handler handler);
+bool sljex_try_call(void (*fn)(void * arg), void * arg, int * excode, char const * * exstr);
+int sljex_try_handlers(void (*fn)(void * arg), void * arg, sljex_handler const * table, size_t count);
+void * sljex_scope_alloc(size_t size);
+bool sljex_scope_promote(void);
+void sljex_task_begin(void);
+void sljex_task_end(void);
+int sljex_collect_end_(sljex_collector * c);
+void sljex_checkpoint(void);
+void sljex_cancel_request(sljex_cancel * token);
+void sljex_cancel_reset(sljex_cancel * token);
+size_t sljex_snapshot_all(sljex_threadsnap * out, size_t max);
+void sljex_set_shrink_threshold(size_t pops);
+void sljex_set_memory_budget(size_t bytes);
+size_t sljex_memory_usage(void);
+void sljex_profile_enable(bool enable);
+void sljex_profile_reset(void);
+size_t sljex_profile_report(sljex_siteprof * out, size_t max);
+void sljex_profile_print(FILE * f, size_t max);
+bool sljex_journal_open(char const * path, size_t threads, size_t events);
+void sljex_journal_close(void);
 
 static bool sljex_exstate_vinit(void * * statespace);
 static void sljex_exstate_vdeinit(void * * statespace);
-static bool vector_vinit(void * * vecspace);
-static void vector_vdeinit(void * * vecspace);
+static bool sljex_thread_vinit(void * * threadspace);
+static void sljex_thread_vdeinit(void * * threadspace);
+static unsigned long long prof_now(void);
+static sljex_siteprof * prof_site(sljex_site * site);
 
 ///holds all the internal information of an exception
 typedef struct sljex_exstate {
@@ -64,135 +150,381 @@ typedef struct sljex_exstate {
     char const * exstr;
     ///indicates whether the exception has already been caught
     bool caught;
+    ///indicates whether the exception is being profiled
+    bool profiled;
+    ///try frames the exception has been delivered to
+    unsigned frames;
+    ///site the exception was originally thrown from
+    sljex_site * site;
+    ///monotonic time of the original throw
+    unsigned long long thrown;
+    ///nanoseconds from the original throw until the catch
+    unsigned long long ns;
+    ///indicates whether the frame is a deadline or cancellation scope
+    bool scope;
+    ///absolute monotonic deadline of a scope, inherited from
+    /// the enclosing scope when tighter, 0 if there is none
+    unsigned long long deadline;
+    ///cancellation flag of a cancellation scope, NULL otherwise
+    sljex_cancel * cancel;
+    ///enclosing scope of a scope
+    struct sljex_exstate * outer;
+    ///collector of a sljex_collect block, NULL otherwise
+    sljex_collector * collector;
+    ///faulting address of an exception raised by a trapped signal, NULL otherwise
+    void * addr;
+    ///indicates whether the frame is a recovery point (sljex_recover)
+    bool root;
+    ///indicates whether the frame is a transaction (sljex_txn_try)
+    bool txn;
+    ///length of the thread's undo log when a transaction frame was pushed
+    size_t txn_start;
+    ///indicates whether the frame has scope allocations, set by the first one
+    bool marked;
+    ///arena block and its usage when the frame's first scope allocation was made,
+    /// everything allocated after it is freed with the frame
+    struct sljex_chunk * mark;
+    size_t mark_used;
 } sljex_exstate;
 
-///holds a reference to a vector<exstate> for each thread,
+///header of an undo log entry, copied in and out with memcpy
+/// since entries are packed without alignment
+typedef struct sljex_txnentry {
+    void * ptr;
+    size_t size;
+} sljex_txnentry;
+
+///holds any basic type, so it is aligned like the most aligned one
+typedef union sljex_maxalign {
+    long double ld;
+    long long ll;
+    void * p;
+    void (*fn)(void);
+} sljex_maxalign;
+
+///places a sljex_maxalign at its alignment
+typedef struct sljex_alignprobe {
+    char c;
+    sljex_maxalign u;
+} sljex_alignprobe;
+
+///block of memory of a thread's scope arena
+typedef struct sljex_chunk {
+    ///previously filled block
+    struct sljex_chunk * prev;
+    ///usable bytes of data
+    size_t size;
+    ///bytes of data handed out
+    size_t used;
+    sljex_maxalign data[];
+} sljex_chunk;
+
+///holds all the internal information of a thread using the library
+typedef struct sljex_thread {
+    ///vector<exstate>, one exstate for each active try
+    vector frames;
+    ///generation counter, odd while the owner is modifying frames
+    unsigned seq;
+    ///thread that owns the record
+    pthread_t id;
+    ///alternate signal stack installed for trapped signals, NULL if none
+    void * altstack;
+    ///terminate handler of the thread, NULL to use the global one
+    sljex_terminate_handler terminate;
+    ///journal region of the thread, NULL if it has none
+    sljex_journal_region * journal;
+    ///journal_gen when journal was claimed
+    unsigned journal_gen;
+    ///block sljex_scope_alloc currently allocates from, NULL if none
+    sljex_chunk * arena;
+    ///emptied block kept to avoid a malloc for the next scope, NULL if none
+    sljex_chunk * spare;
+    ///undo log of the thread's transactions, entries of
+    /// a sljex_txnentry, the logged bytes and the entry's total size
+    char * txnlog;
+    size_t txnlen;
+    size_t txncap;
+    ///number of transaction frames on the thread's stack
+    unsigned txns;
+    ///whether the thread is between sljex_task_begin and sljex_task_end
+    bool task;
+    ///try depth, arena top and innermost scope at sljex_task_begin
+    size_t task_depth;
+    sljex_chunk * task_mark;
+    size_t task_used;
+    struct sljex_exstate * task_scope;
+    ///undo log length and transaction count at sljex_task_begin
+    size_t task_txnlen;
+    unsigned task_txns;
+#ifdef SLJEX_ENGINE_UNWIND
+    ///exception object handed to the unwinder while throwing
+    struct _Unwind_Exception unwind;
+#endif
+    ///innermost deadline or cancellation scope, NULL if there is none
+    sljex_exstate * scope;
+} sljex_thread;
+
+///gets the exception stack of a thread, NULL if the thread has not used try yet
+#define thread_frames(local) ((local) != NULL ? &(local)->frames : NULL)
+
+//the owner of a thread record brackets every modification of its frames
+// with seq_begin/seq_end, so sljex_snapshot_all can detect and retry
+// torn reads without the owner ever taking a lock
+#define seq_begin(local) do{\
+    __atomic_store_n(&(local)->seq, (local)->seq + 1, __ATOMIC_RELAXED);\
+    __atomic_thread_fence(__ATOMIC_RELEASE);}while(0)
+#define seq_end(local)\
+    __atomic_store_n(&(local)->seq, (local)->seq + 1, __ATOMIC_RELEASE)
+
+///profiling data of a site, linked into a global list
+typedef struct sljex_siteprof_node {
+    sljex_siteprof prof;
+    struct sljex_siteprof_node * next;
+    ///copies of the site's file and func strings, pointed to by prof
+    char names[];
+} sljex_siteprof_node;
+
+static void prof_throw(sljex_exstate * state, sljex_site * site);
+static void prof_retire(sljex_exstate * state);
+static void prof_clear(void);
+static sljex_siteprof_node * prof_node(sljex_site const * site);
+static sljex_thread * thread_register(void);
+static sljex_exstate * exstate_push(sljex_thread * local);
+static void exstate_pop(sljex_thread * local);
+static void exstate_drop(sljex_thread * local);
+static void arena_release(sljex_thread * local, sljex_chunk * mark, size_t used);
+static void txn_rollback(sljex_thread * local, size_t start);
+static void registry_lock(void);
+static void registry_unlock(void);
+static jmp_buf_ptr collect(sljex_exstate * local_state, int excode, char const * exstr);
+static void thread_altstack(sljex_thread * local);
+static void terminate(sljex_thread * local, size_t below, int excode, char const * exstr, sljex_site * site);
+static jmp_buf_ptr deliver(sljex_thread * local, size_t index, int excode, char const * exstr, sljex_site * site);
+static void journal_write(sljex_thread * local, int kind, int excode, char const * exstr, sljex_site const * site);
+static void trap_handler(int sig, siginfo_t * info, void * context);
+static void trap_chain(size_t i, int sig, siginfo_t * info, void * context);
+static void fork_prepare(void);
+static void fork_parent(void);
+static void fork_child(void);
+static void sljex_unload(void) __attribute__((destructor));
+#ifdef SLJEX_CHECKED
+static void misuse(char const * what);
+#endif
+
+///holds a reference to the thread record of each thread,
 /// allocated and given by global_local_vec_holder
-static pthread_key_t tlvec;
-///stores the vector<exstate> threadlocal values to destroy all at once
+static pthread_key_t tlthread;
+#if __STDC_VERSION__ >= 201112L
+///generation the current thread registered its record in
+static _Thread_local unsigned tlgen;
+///gets the record of the current thread, NULL if it has none
+/// or the library was torn down since it registered
+#define thread_get()\
+    (likely(tlgen == counter_load(&generation)) ? pthread_getspecific(tlthread) : NULL)
+#define thread_setgen() (tlgen = generation)
+#else
+//deleting the key on teardown already forgets every record,
+// and the key holds nothing before the library is first set up
+#define thread_get()\
+    (likely(counter_load(&initialized)) ? pthread_getspecific(tlthread) : NULL)
+#define thread_setgen() (void)0
+#endif
+///stores the thread record threadlocal values to destroy all at once
 static vector global_local_vec_holder;
-///global used to sync pushes to global_local_vec_holder
-static pthread_mutex_t mtx;
+///global used to sync pushes to global_local_vec_holder,
+/// registration of profiled sites and initialization,
+/// statically initialized so it is never destroyed
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+///shrinking policy and accounting of every thread's exception stack
+static vector_budget frames_budget = {
+    SLJEX_SHRINK_DEFAULT, 0, sizeof(sljex_exstate), 0, registry_lock, registry_unlock
+};
+///whether the library is initialized, checked by fork_child
+/// since the fork handlers stay registered after teardown
+static bool initialized;
+///references taken by sljex_init and sljex_initNoCleanup
+static unsigned refs;
+///whether the library was initialized by a thread's first try,
+/// it is then only torn down when unloaded
+static bool pinned;
+///advanced by each teardown, thread records registered
+/// in an earlier generation have been released
+static unsigned generation;
+///whether the fork handlers have been registered
+static bool atfork_registered;
+///terminate handler of threads without their own, NULL to exit
+static sljex_terminate_handler terminate_handler;
+///SLJEX_TRAP_ flags of the signals currently converted to exceptions
+static int traps;
+///signals that can be trapped, and their exceptions
+static struct {
+    int flag;
+    int sig;
+    int excode;
+    char const * exstr;
+} const trappable[] = {
+    {SLJEX_TRAP_SEGV, SIGSEGV, EXSEGV, "EXSEGV"},
+    {SLJEX_TRAP_BUS, SIGBUS, EXBUS, "EXBUS"},
+    {SLJEX_TRAP_FPE, SIGFPE, EXFPE, "EXFPE"},
+};
+///actions of trappable signals from before they were trapped
+static struct sigaction untrapped[sizeof(trappable) / sizeof(trappable[0])];
+///alternate stacks a teardown left installed on other threads,
+/// which only those threads can uninstall, so they are never freed
+/// but taken back by their thread when it registers again
+static void * * stray_altstacks;
+static size_t stray_count;
+///mapped journal file, NULL while not journaling
+static sljex_journal_header * journal;
+///size of the journal mapping
+static size_t journal_size;
+///incremented by each sljex_journal_open, so regions of a
+/// previous journal are not written to, never 0 while journaling
+static unsigned journal_gen;
+///whether throws are currently being profiled
+static bool prof_enabled;
+///every site profiled since the process started, kept across
+/// reinitialization since sites point to their node
+static sljex_siteprof_node * prof_sites;
 
 /**
-    initialize the library without automatic atexit cleanup
+    sets up the library state
 @pre
-    this is called exactly once before using any library functions
-@post
-    the library will be ready for use
+    mtx is locked and the library is not initialized
 @returns
-    false if initialization fails,
-    library is left in an uninitialized state
-@note
-    does not store sljex_deinit on atexit stack,
-    sljex_deinit must be called manually before program exit,
-    and memory will leak to OS if program ends (or panics) before it is called.
-@note
-    the library may be loaded by the user at runtime since
-    deinitialization is handled manually.
+    false if setup fails, the library is left uninitialized
 */
-bool sljex_initNoCleanup(void) {
-    if(pthread_mutex_init(&mtx, NULL)){
-        return false;
-    }else if(pthread_key_create(&tlvec, NULL)){
-        pthread_mutex_destroy(&mtx);
+static bool setup(void) {
+    if(pthread_key_create(&tlthread, NULL)){
         return false;
-    }else if(!vector_init(&global_local_vec_holder, vector_vinit, vector_vdeinit)){
-        pthread_mutex_destroy(&mtx);
-        pthread_key_delete(tlvec);
+    }else if(!vector_init(&global_local_vec_holder, sljex_thread_vinit, sljex_thread_vdeinit)){
+        pthread_key_delete(tlthread);
         return false;
     }
+    //fork handlers cannot be unregistered, so they are only registered
+    // by the first setup (glibc drops them itself if the library is unloaded)
+    if(!atfork_registered){
+        if(pthread_atfork(fork_prepare, fork_parent, fork_child)){
+            vector_deinit(&global_local_vec_holder);
+            pthread_key_delete(tlthread);
+            return false;
+        }
+        atfork_registered = true;
+    }
+    initialized = true;
     return true;
 }
 
 /**
-    initialize the library
+    tears down the library state
 @pre
-    this is called exactly once before
-    using any library functions
+    mtx is locked and the library is initialized,
+    no thread is inside a try block
+@post
+    every thread record is released, and the generation is advanced
+    so threads register again on their next try
+*/
+static void teardown(void) {
+    initialized = false;
+    pinned = false;
+    refs = 0;
+    sljex_trap_signals(0);
+    sljex_journal_close();
+    //profiling data is cleared but kept, the static sites of client
+    // modules still point to it and may already be unmapped (dlclose),
+    // which is also why it keeps its own copy of their strings
+    prof_clear();
+    vector_deinit(&global_local_vec_holder);
+    pthread_key_delete(tlthread);
+    counter_store(&generation, generation + 1);
+}
+
+/**
+    takes a reference to the library, initializing it if needed
 @post
     the library will be ready for use
 @returns
     false if initialization fails,
-        library is left in an uninitialized state
+    library is left in an uninitialized state
 @note
-    stores sljex_deinit on atexit stack, to automatically perform cleanup,
-    do not load this library at runtime with custom/dynamic or similar,
-    or at least do not close the library.
+    optional, the first try of the process initializes the library,
+    may be called from any thread, any number of times
 */
-bool sljex_init(void) {
-    if(sljex_initNoCleanup()){
-        atexit(sljex_deinit);
-        return true;
+bool sljex_initNoCleanup(void) {
+    pthread_mutex_lock(&mtx);
+    bool const ok = initialized || setup();
+    if(ok){
+        refs++;
     }
-    return false;
+    pthread_mutex_unlock(&mtx);
+    return ok;
 }
 
 /**
-    deinitializes the library
-@pre
-    the library has been initialized exactly once
+    takes a reference to the library, initializing it if needed
+@note
+    same as sljex_initNoCleanup, teardown no longer relies on atexit
+    since the library tears itself down when it is unloaded
+*/
+bool sljex_init(void) {
+    return sljex_initNoCleanup();
+}
+
+/**
+    releases a reference taken by sljex_init or sljex_initNoCleanup
 @post
-    the library is fully deinitialized
+    the library is deinitialized once the last reference is released,
+    unless it was initialized by a try before any sljex_init,
+    then it stays initialized until it is unloaded
 @note
-    called automatically using atexit if initialized with sljex_init
-    and not sljex_initNoCleanup
+    does nothing if no reference is held
 */
 void sljex_deinit(void) {
-    vector_deinit(&global_local_vec_holder);
-    pthread_key_delete(tlvec);
-    pthread_mutex_destroy(&mtx);
+    pthread_mutex_lock(&mtx);
+    if(refs > 0 && --refs == 0 && initialized && !pinned){
+        teardown();
+    }
+    pthread_mutex_unlock(&mtx);
+}
+
+/**
+    tears down the library when it is unloaded (dlclose) or the process exits
+@note
+    skipped if another thread holds the registry at exit,
+    the memory is returned to the OS either way
+*/
+static void sljex_unload(void) {
+    if(pthread_mutex_trylock(&mtx)){
+        return;
+    }
+    if(initialized){
+        teardown();
+    }
+    pthread_mutex_unlock(&mtx);
 }
 
 /**
     internal function used in the try macro,
     not meant to be called directly
 @pre
-    library has been initialized exactly once
+    library is initialized, explicitly or by a try
 @post
     panics if mutex cannot be locked or thread local storage cannot be set,
     otherwise a new exstate is pushed to the global stack,
+    its depth is stored in depth for the matching sljex_finally_,
     and its jmp_buf member is returned as a reference.
 @note
     the library should be properly deinitialized even upon failure
 */
-jmp_buf_ptr sljex_trybuf_(void) {
-    //get the current thread's exception stack
-    vector * local_vec = pthread_getspecific(tlvec);
-    //initialize the thread's exstate vector if it doesn't exist
-    if(local_vec == NULL){
-        if(pthread_mutex_lock(&mtx)){
-            panic("sljex: failed to lock mutex.\n");
-        }
-        //panic if adding a new default-initialized
-        // vector to the global stack fails
-        if(!vector_pushInit(&global_local_vec_holder)){
-            //cannot delete a mutex while locked
-            pthread_mutex_unlock(&mtx);//should be impossible to fail if lock succeeded
-            //calls sljex_deinit through exit, which deletes the mutex
-            panic("sljex: failed to allocate exception vector.\n");
-        }
-        //get a reference to the new vector instance
-        local_vec = vector_getLast(&global_local_vec_holder);
-        //panic if setting threadlocal storage to
-        // the new vector instance reference fails,
-        if(pthread_setspecific(tlvec, local_vec)){
-            //cannot delete a mutex while locked
-            pthread_mutex_unlock(&mtx);//should be impossible to fail if lock succeeded
-            //calls sljex_deinit through exit, which deletes the mutex
-            panic("sljex: failed to initalize threadlocal exception vector.\n");
-        }
-        pthread_mutex_unlock(&mtx);//should be impossible to fail if lock succeeded
-    }
-    
-    //create a new default initialzed exstate instance,
-    // and panic if initialization fails
-    if(!vector_pushInit(local_vec)){
-        panic("sljex: failed to initalize threadlocal exception state.\n");
+jmp_buf_ptr sljex_trybuf_(size_t * depth) {
+    //get the current thread's record, registering the thread on its first try
+    sljex_thread * local = thread_get();
+    if(unlikely(local == NULL)){
+        local = thread_register();
     }
-    //obtain reference to newly created exstate instance
-    sljex_exstate * local_state = vector_getLast(local_vec);
-    //return a reference the the exstate instance's jump_buf member
+    sljex_exstate * local_state = exstate_push(local);
+    *depth = vector_size(&local->frames);
+    //return a reference the the new exstate instance's jump_buf member
     return local_state->jb;
 }
 
@@ -200,7 +532,7 @@ jmp_buf_ptr sljex_trybuf_(void) {
     internal function used in catch macro,
     not meant to be called directly
 @pre
-    the library has been initialized exactly once
+    the library is initialized, explicitly or by a try
 @post
     panics if called without an associated try statement
 @returns
@@ -211,23 +543,30 @@ jmp_buf_ptr sljex_trybuf_(void) {
 */
 bool sljex_catch_(int excode) {
     //obtain a reference to the current thread's exception stack
-    vector * local_vec = pthread_getspecific(tlvec);
-    //stores reference to exception state being caught
-    sljex_exstate * local_state;
-    //Obtain a reference to the current exception state.
+    sljex_thread * local = thread_get();
+    vector * local_vec = thread_frames(local);
     //If there are no exceptions on the stack
     // or the current exception was caught already,
     // then catch was called without a
     // try statement and function will panic
-    if(vector_size(local_vec) == 0 || (local_state = vector_getLast(local_vec))->caught){
-        panic("sljex: catch without try.\n");
-    }
+    check(
+        vector_size(local_vec) > 0 && !((sljex_exstate *)vector_getLast(local_vec))->caught,
+        "catch without try"
+    );
+    //obtain a reference to the current exception state.
+    sljex_exstate * local_state = vector_getLast(local_vec);
     //return true if the thrown exception's excode
     // matches the excode argument
     if(local_state->excode == excode){
         //sets the current exception's state to caught
         // to avoid accidental recatching
+        seq_begin(local);
         local_state->caught = true;
+        seq_end(local);
+        //measure throw-to-catch latency from the original throw
+        if(local_state->profiled){
+            local_state->ns = prof_now() - local_state->thrown;
+        }
         return true;
     }
     //return false otherwise
@@ -238,7 +577,7 @@ bool sljex_catch_(int excode) {
     internal function used in the catchany macro,
     not meant to be called directly
 @pre
-    the library has been initialized exactly once,
+    the library is initialized, explicitly or by a try,
 @post
     always returns true
 @returns
@@ -249,20 +588,27 @@ bool sljex_catch_(int excode) {
 */
 bool sljex_catchany_(void) {
     //obtain a reference to the current thread's exception stack
-    vector * local_vec = pthread_getspecific(tlvec);
-    //stores reference to exception state being caught
-    sljex_exstate * local_state;
-    //Obtain a reference to the current exception state.
+    sljex_thread * local = thread_get();
+    vector * local_vec = thread_frames(local);
     //If there are no exceptions on the stack
     // or the current exception was caught already,
     // then catch was called without a
     // try statement and function will panic
-    if(vector_size(local_vec) == 0 || (local_state = vector_getLast(local_vec))->caught){
-        panic("sljex: catchany without try.\n");
-    }
+    check(
+        vector_size(local_vec) > 0 && !((sljex_exstate *)vector_getLast(local_vec))->caught,
+        "catchany without try"
+    );
+    //obtain a reference to the current exception state.
+    sljex_exstate * local_state = vector_getLast(local_vec);
     //sets the current exception's state to caught
     // to avoid accidental recatching
+    seq_begin(local);
     local_state->caught = true;
+    seq_end(local);
+    //measure throw-to-catch latency from the original throw
+    if(local_state->profiled){
+        local_state->ns = prof_now() - local_state->thrown;
+    }
     return true;
 }
 
@@ -270,31 +616,50 @@ bool sljex_catchany_(void) {
     internal function used in the throw and throwWithMsg macros,
     not meant to be called directly
 @pre
-    library has been initialized exactly once
+    library is initialized, explicitly or by a try
 @note
     calls panic if called outside a try block,
     intentional behavior that mimics C++'s exception handling, not a failure
 @note
     the library should be properly deinitialized when panic is called
 */
-jmp_buf_ptr sljex_throwbuf_(int excode, char const * exstr) {
+jmp_buf_ptr sljex_throwbuf_(int excode, char const * exstr, sljex_site * site) {
     //obtain a reference to the current thread's exception stack
-    vector * local_vec = pthread_getspecific(tlvec);
+    sljex_thread * local = thread_get();
+    vector * local_vec = thread_frames(local);
     //discards a previously caught exception
-    if(vector_size(local_vec) > 0 && ((sljex_exstate *)vector_getLast(local_vec))->caught){
-        vector_popDeinit(local_vec);
+    if(likely(vector_size(local_vec) > 0) && ((sljex_exstate *)vector_getLast(local_vec))->caught){
+        prof_retire(vector_getLast(local_vec));
+        exstate_pop(local);
+    }
+    if(unlikely(journal != NULL)){
+        journal_write(local, SLJEX_JOURNAL_THROW, excode, exstr, site);
     }
     //if there is no valid exstate instance to assign to,
     // then throw was called outside a catch block and is an
     // unhandled exception, and the function panics
-    if(vector_size(local_vec) == 0){
-        panic("sljex_terminate: unhandled \"%s\"(%d) thrown.\n", exstr, excode);
+    if(unlikely(vector_size(local_vec) == 0)){
+        terminate(local, 0, excode, exstr, site);
     }
     //obtain a reference to the current exception state
     sljex_exstate * local_state = vector_getLast(local_vec);
+    //exceptions thrown directly to a sljex_collect block are
+    // recorded and its loop resumes with the next item
+    if(local_state->collector != NULL){
+        prof_throw(local_state, site);
+        return collect(local_state, excode, exstr);
+    }
+    //a transaction is rolled back before its catch blocks run
+    if(local_state->txn){
+        txn_rollback(local, local_state->txn_start);
+    }
     //assign exception info to exstate
+    seq_begin(local);
     local_state->excode = excode;
     local_state->exstr = exstr;
+    local_state->addr = NULL;
+    prof_throw(local_state, site);
+    seq_end(local);
     //return a reference to the exstate's jmp_buf member
     return local_state->jb;
 }
@@ -303,7 +668,7 @@ jmp_buf_ptr sljex_throwbuf_(int excode, char const * exstr) {
     internal function used by the rethrow macro,
     not meant to be called directly
 @pre
-    library has been initialized exactly once
+    library is initialized, explicitly or by a try
 @post
     panics if called outside a try block
 @note
@@ -312,37 +677,75 @@ jmp_buf_ptr sljex_throwbuf_(int excode, char const * exstr) {
 @note
     the library should be properly deinitialized when panic is called
 */
-jmp_buf_ptr sljex_rethrowbuf_(void) {
+jmp_buf_ptr sljex_rethrowbuf_(sljex_site * site) {
     //obtain a reference to the current thread's exception stack
-    vector * local_vec = pthread_getspecific(tlvec);
-    //stores reference to current caught, and then new uncaught exception.
-    sljex_exstate * local_state;
-    //stores current caught exception into local_state
+    sljex_thread * local = thread_get();
+    vector * local_vec = thread_frames(local);
     //if there is no current caught exception to rethrow,
     // rethrow was called outside catch/catchany,
     // and the function panics to report a programmer error.
-    if(vector_size(local_vec) == 0 || !(local_state = (sljex_exstate *)vector_getLast(local_vec))->caught){
-        panic("sljex: rethrow outside catch/catchany.\n");
-    }
+    check(
+        vector_size(local_vec) > 0 && ((sljex_exstate *)vector_getLast(local_vec))->caught,
+        "rethrow outside catch/catchany"
+    );
+    //stores reference to current caught, and then new uncaught exception.
+    sljex_exstate * local_state = vector_getLast(local_vec);
     
     int const excode = local_state->excode;
     char const * const exstr = local_state->exstr;
+    void * const addr = local_state->addr;
+    //the origin of the exception is kept across rethrows,
+    // the rethrowing site is only counted
+    bool const profiled = local_state->profiled;
+    unsigned const frames = local_state->frames;
+    sljex_site * const origin = local_state->site;
+    unsigned long long const thrown = local_state->thrown;
+    if(profiled){
+        sljex_siteprof * prof = prof_site(site);
+        if(prof != NULL){
+            counter_add(&prof->rethrows, 1);
+        }
+    }
     
     //delete current, caught exception (invalidates local_state)
-    vector_popDeinit(local_vec);
+    exstate_pop(local);
+    if(unlikely(journal != NULL)){
+        journal_write(local, SLJEX_JOURNAL_RETHROW, excode, exstr, site);
+    }
     
     //if there is no valid exstate instance to assign to,
     // then rethrow was called outside a catch block and is an
     // unhandled exception, and the function panics
-    if(vector_size(local_vec) == 0){
-        panic("sljex_terminate: unhandled \"%s\"(%d) thrown.\n", exstr, excode);
+    if(unlikely(vector_size(local_vec) == 0)){
+        terminate(local, 0, excode, exstr, origin);
     }
     
     //obtain a reference to the new current exception state
     local_state = vector_getLast(local_vec);
+    //exceptions propagated to a sljex_collect block are
+    // recorded and its loop resumes with the next item
+    if(local_state->collector != NULL){
+        local_state->profiled = profiled;
+        local_state->frames = frames + 1;
+        local_state->site = origin;
+        local_state->thrown = thrown;
+        return collect(local_state, excode, exstr);
+    }
+    //a transaction is rolled back before its catch blocks run
+    if(local_state->txn){
+        txn_rollback(local, local_state->txn_start);
+    }
     //assign exception info to exstate
+    seq_begin(local);
     local_state->excode = excode;
     local_state->exstr = exstr;
+    local_state->addr = addr;
+    local_state->profiled = profiled;
+    local_state->frames = frames + 1;
+    local_state->site = origin;
+    //the next catch measures its latency from the original throw
+    local_state->thrown = thrown;
+    seq_end(local);
     //return a reference to the exstate's jmp_buf member
     return local_state->jb;
 }
@@ -351,38 +754,53 @@ jmp_buf_ptr sljex_rethrowbuf_(void) {
     cleans up exstate in the case that no exceptions were thrown,
     and terminates program if there is an uncaught exception remaining
 @pre
-    library has been initialized exactly once,
-    and finally block follows a try block
+    library is initialized, explicitly or by a try,
+    and finally block follows a try block,
+    depth is the depth stored by that try
 @post
-    cleans up exception state created by try
+    cleans up exception state created by try,
+    along with the caught exceptions of inner try blocks
+    that were left by returning from their catch blocks
 @note
     intentionally calls panic if called with an active exception state (unvaught exception)
     to mimics C++'s exception handling, not a failure.
 */
-void sljex_finally_(void) {
+void sljex_finally_(size_t depth) {
     //obtain a reference to the current thread's exception stack
-    vector * local_vec = pthread_getspecific(tlvec);
+    sljex_thread * local = thread_get();
+    vector * local_vec = thread_frames(local);
     //the try & finally macros ensure there is no 
     // easy way to call try and finally unpaired,
-    // so the runtime check has been removed.
+    // so the runtime check is only done by the checked build.
+    check(vector_size(local_vec) >= depth, "finally without try");
+    //inner try blocks that were returned from inside a catch block
+    // never reached their finally, release them now
+    while(unlikely(vector_size(local_vec) > depth)){
+        sljex_exstate * inner = vector_getLast(local_vec);
+        //returning from inside a try block itself is not supported
+        check(inner->caught, "try block left without reaching its finally");
+        prof_retire(inner);
+        exstate_pop(local);
+    }
     //stores reference to exception state being caught
     sljex_exstate * local_state = vector_getLast(local_vec);
     //if the current exstate excode is not 0 and is uncaught,
-    // it is an unhandled exception, and the function panics
-    if(local_state->excode != 0 && !local_state->caught){
-        panic(
-            "sljex_terminate: unhandled \"%s\"(%d) thrown.\n",
-            local_state->exstr, local_state->excode
-        );
+    // it is an unhandled exception, and the function terminates
+    if(unlikely(local_state->excode != 0 && !local_state->caught)){
+        terminate(local, depth - 1, local_state->excode, local_state->exstr, local_state->site);
+    }
+    //record a handled exception before its exstate is released
+    if(local_state->caught){
+        prof_retire(local_state);
     }
     //cleans up exstate created by try
-    vector_popDeinit(local_vec);
+    exstate_pop(local);
 }
 
 /**
     gets the integer code of the current exception
 @pre
-    library has been initialized exactly once,
+    library is initialized, explicitly or by a try,
     and the function is called inside a catch/catchany block
 @post
     fails and calls panic if called outside catch/catchany
@@ -390,15 +808,17 @@ void sljex_finally_(void) {
     the integer code representing the exception type
 */
 int sljex_excode(void) {
-    vector * local_vec = pthread_getspecific(tlvec);
-    //stores reference to exception state being caught
-    sljex_exstate * local_state;
+    sljex_thread * local = thread_get();
+    vector * local_vec = thread_frames(local);
     //if there is no valid exstate instance to access,
     // then sljex_excode was called outside a catch block
     // and the function panics to report a programmer error
-    if(vector_size(local_vec) == 0 || !(local_state = vector_getLast(local_vec))->caught){
-        panic("sljex: sljex_excode outside catch/catchany.\n");
-    }
+    check(
+        vector_size(local_vec) > 0 && ((sljex_exstate *)vector_getLast(local_vec))->caught,
+        "sljex_excode outside catch/catchany"
+    );
+    //stores reference to exception state being caught
+    sljex_exstate * local_state = vector_getLast(local_vec);
     //return the excode of the current exception
     return local_state->excode;
 }
@@ -406,7 +826,7 @@ int sljex_excode(void) {
 /**
     gets the string message of the current exception
 @pre
-    library has been initialized exactly once,
+    library is initialized, explicitly or by a try,
     and the function is called inside a catch/catchany block
 @post
     fails and calls panic if called outside catch/catchany
@@ -417,88 +837,1741 @@ int sljex_excode(void) {
     throwWithMsg is used
 */
 char const * sljex_exstr(void) {
-    vector * local_vec = pthread_getspecific(tlvec);
-    //stores reference to exception state being caught
-    sljex_exstate * local_state;
+    sljex_thread * local = thread_get();
+    vector * local_vec = thread_frames(local);
     //if there is no valid exstate instance to access,
-    // then sljex_excode was called outside a catch block
+    // then sljex_exstr was called outside a catch block
     // and the function panics to report a programmer error
-    if(vector_size(local_vec) == 0 || !(local_state = vector_getLast(local_vec))->caught){
-        panic("sljex: sljex_exstr outside catch/catchany.\n");
-    }
+    check(
+        vector_size(local_vec) > 0 && ((sljex_exstate *)vector_getLast(local_vec))->caught,
+        "sljex_exstr outside catch/catchany"
+    );
+    //stores reference to exception state being caught
+    sljex_exstate * local_state = vector_getLast(local_vec);
     //return the exstr of the current exception
     return local_state->exstr;
 }
 
 /**
-    internal function passed to vector_init that allocates a new exstate in-place,
-    should not be called manually
+    internal function used in the sljex_recover macro,
+    not meant to be called directly
 @pre
-    statespace represents an unallocated exstate slot in a vector
+    library is initialized, explicitly or by a try
 @post
-    statespace is assigned a new valid, allocated exspace instance
+    a new exstate is pushed like sljex_trybuf_,
+    and marked as a recovery point for unhandled exceptions
+*/
+jmp_buf_ptr sljex_recoverbuf_(size_t * depth) {
+    sljex_thread * local = thread_get();
+    if(local == NULL){
+        local = thread_register();
+    }
+    sljex_exstate * local_state = exstate_push(local);
+    local_state->root = true;
+    *depth = vector_size(&local->frames);
+    return local_state->jb;
+}
+
+/**
+    internal function used in the sljex_txn_try macro,
+    not meant to be called directly
+@pre
+    the library is initialized, explicitly or by a try
+@post
+    a new exstate is pushed like sljex_trybuf_,
+    and marked as a transaction starting at the current end of the undo log
+*/
+jmp_buf_ptr sljex_txnbuf_(size_t * depth) {
+    sljex_thread * local = thread_get();
+    if(local == NULL){
+        local = thread_register();
+    }
+    sljex_exstate * local_state = exstate_push(local);
+    local_state->txn = true;
+    local_state->txn_start = local->txnlen;
+    local->txns++;
+    *depth = vector_size(&local->frames);
+    return local_state->jb;
+}
+
+/**
+    appends the current contents of memory to the undo log
+@post
+    panics if the log cannot grow,
+    does nothing outside of transactions
+*/
+void sljex_txn_log(void * ptr, size_t size) {
+    sljex_thread * local = thread_get();
+    check(local != NULL && local->txns > 0, "sljex_txn_log outside sljex_txn_try");
+    if(local == NULL || local->txns == 0){
+        return;
+    }
+    //the entry and the log holding it must not wrap around
+    if(size > SIZE_MAX - sizeof(sljex_txnentry) - sizeof(size_t) - local->txnlen){
+        panic("sljex: failed to grow the transaction log.\n");
+    }
+    size_t const total = sizeof(sljex_txnentry) + size + sizeof(size_t);
+    if(local->txncap - local->txnlen < total){
+        size_t const needed = local->txnlen + total;
+        size_t cap = local->txncap != 0 ? local->txncap : 256;
+        while(cap < needed){
+            cap = cap <= SIZE_MAX / 2 ? cap * 2 : needed;
+        }
+        char * log = realloc(local->txnlog, cap);
+        if(log == NULL){
+            panic("sljex: failed to grow the transaction log.\n");
+        }
+        local->txnlog = log;
+        local->txncap = cap;
+    }
+    //the total size trails the entry so the log can be walked backwards
+    char * entry = local->txnlog + local->txnlen;
+    sljex_txnentry const header = {ptr, size};
+    memcpy(entry, &header, sizeof(header));
+    memcpy(entry + sizeof(header), ptr, size);
+    memcpy(entry + sizeof(header) + size, &total, sizeof(total));
+    local->txnlen += total;
+}
+
+/**
+    logs memory and overwrites it
+@post
+    size bytes of value are copied to ptr,
+    and restored if the transaction is rolled back
+*/
+void sljex_txn_write(void * ptr, void const * value, size_t size) {
+    sljex_txn_log(ptr, size);
+    memcpy(ptr, value, size);
+}
+
+/**
+    restores the memory logged after start, newest entry first
+@post
+    the undo log is truncated to start
+*/
+static void txn_rollback(sljex_thread * local, size_t start) {
+    while(local->txnlen > start){
+        size_t total;
+        memcpy(&total, local->txnlog + local->txnlen - sizeof(total), sizeof(total));
+        local->txnlen -= total;
+        char const * entry = local->txnlog + local->txnlen;
+        sljex_txnentry header;
+        memcpy(&header, entry, sizeof(header));
+        memcpy(header.ptr, entry + sizeof(header), header.size);
+    }
+}
+
+/**
+    sets the terminate handler used by threads without their own
+@post
+    unhandled exceptions are passed to handler,
+    NULL restores the default of exiting the process
 @returns
-    false if fails to initialize, statespace is unchanged
+    the previous global handler
 */
-bool sljex_exstate_vinit(void * * statespace) {
-    //allocate memory for the new exstate
-    sljex_exstate * sp = malloc(sizeof(sljex_exstate));
-    if(sp == NULL){
+sljex_terminate_handler sljex_set_terminate_handler(sljex_terminate_handler handler) {
+    return __atomic_exchange_n(&terminate_handler, handler, __ATOMIC_ACQ_REL);
+}
+
+/**
+    sets the terminate handler of the current thread
+@pre
+    library is initialized, explicitly or by a try
+@post
+    unhandled exceptions on the current thread are passed to handler,
+    NULL makes the thread use the global handler again
+@returns
+    the thread's previous handler
+*/
+sljex_terminate_handler sljex_set_thread_terminate_handler(sljex_terminate_handler handler) {
+    sljex_thread * local = thread_get();
+    if(local == NULL){
+        local = thread_register();
+    }
+    sljex_terminate_handler const previous = local->terminate;
+    local->terminate = handler;
+    return previous;
+}
+
+/**
+    allocates memory freed along with the innermost frame
+@returns
+    size bytes aligned for any type,
+    NULL outside of try blocks or if no memory can be allocated
+@note
+    a frame's first allocation marks the top of the arena,
+    releasing the frame frees everything above the mark at once
+*/
+void * sljex_scope_alloc(size_t size) {
+    sljex_thread * local = thread_get();
+    vector * local_vec = thread_frames(local);
+    //rounding up and adding the block header must not wrap around
+    if(vector_size(local_vec) == 0 || size > SIZE_MAX - sizeof(sljex_chunk) - SLJEX_SCOPE_ALIGN){
+        return NULL;
+    }
+    sljex_exstate * local_state = vector_getLast(local_vec);
+    if(!local_state->marked){
+        local_state->marked = true;
+        local_state->mark = local->arena;
+        local_state->mark_used = local->arena != NULL ? local->arena->used : 0;
+    }
+    size = (size + SLJEX_SCOPE_ALIGN - 1) & ~(SLJEX_SCOPE_ALIGN - 1);
+    sljex_chunk * chunk = local->arena;
+    if(chunk == NULL || chunk->size - chunk->used < size){
+        //start a new block, the rest of the current one is left unused
+        if(size <= SLJEX_SCOPE_CHUNK && local->spare != NULL){
+            chunk = local->spare;
+            local->spare = NULL;
+        }else{
+            size_t const chunk_size = size > SLJEX_SCOPE_CHUNK ? size : SLJEX_SCOPE_CHUNK;
+            chunk = malloc(sizeof(sljex_chunk) + chunk_size);
+            if(chunk == NULL){
+                return NULL;
+            }
+            chunk->size = chunk_size;
+        }
+        chunk->used = 0;
+        chunk->prev = local->arena;
+        local->arena = chunk;
+    }
+    void * memory = (char *)chunk->data + chunk->used;
+    chunk->used += size;
+    return memory;
+}
+
+/**
+    moves the scope allocations of the innermost frame to the enclosing frame
+@post
+    the allocations are freed along with the enclosing frame instead
+@returns
+    false if there is no enclosing frame, nothing is changed
+*/
+bool sljex_scope_promote(void) {
+    sljex_thread * local = thread_get();
+    vector * local_vec = thread_frames(local);
+    size_t const depth = vector_size(local_vec);
+    //the enclosing frame is released after the task,
+    // which already frees everything the task allocated
+    if(depth < 2 || (local->task && depth - 1 <= local->task_depth)){
         return false;
     }
-    //initialize members to show that exstate
-    // does not currently hold an exception.
-    sp->excode = 0;//excode 0 means not-an-exception
-    sp->caught = false;
-    //assign the new exstate to the reference
-    // and return indicating success
-    *statespace = sp;
+    sljex_exstate * local_state = vector_get(local_vec, depth - 1);
+    sljex_exstate * outer = vector_get(local_vec, depth - 2);
+    //a marked enclosing frame already covers everything above its own,
+    // lower mark, an unmarked one takes over the inner frame's mark
+    if(local_state->marked && !outer->marked){
+        outer->marked = true;
+        outer->mark = local_state->mark;
+        outer->mark_used = local_state->mark_used;
+    }
+    local_state->marked = false;
     return true;
 }
 
 /**
-    internal function passed to vector_init that deinitializes an exstate in-place,
-    should not be called manually
+    starts a task on the current thread
+@post
+    the thread's try depth, innermost scope and arena top are
+    recorded for sljex_task_end
+*/
+void sljex_task_begin(void) {
+    sljex_thread * local = thread_get();
+    if(local == NULL){
+        local = thread_register();
+    }
+    check(!local->task, "sljex_task_begin inside a task");
+    vector * local_vec = &local->frames;
+    local->task = true;
+    local->task_depth = vector_size(local_vec);
+    local->task_scope = local->scope;
+    //marking the innermost frame keeps every mark at or below the task's,
+    // so the frame survives the task freeing what was allocated in it
+    if(local->task_depth > 0){
+        sljex_exstate * local_state = vector_getLast(local_vec);
+        if(!local_state->marked){
+            local_state->marked = true;
+            local_state->mark = local->arena;
+            local_state->mark_used = local->arena != NULL ? local->arena->used : 0;
+        }
+    }
+    local->task_mark = local->arena;
+    local->task_used = local->arena != NULL ? local->arena->used : 0;
+    local->task_txnlen = local->txnlen;
+    local->task_txns = local->txns;
+}
+
+/**
+    ends the task started on the current thread
 @pre
-    statespace is a valid, allocated exstate instance
+    sljex_task_begin was called on the thread,
+    the thread is not inside a try block entered before it
+    that has since been finished
 @post
-    statespace's instance will be deallocated
+    frames above the task's depth are dropped in one step,
+    caught exceptions among them are still counted by the profiler,
+    and the task's scope allocations are freed
 */
-static void sljex_exstate_vdeinit(void * * statespace) {
-    free(*statespace);
+void sljex_task_end(void) {
+    sljex_thread * local = thread_get();
+    check(local != NULL && local->task, "sljex_task_end without sljex_task_begin");
+    if(local == NULL || !local->task){
+        return;
+    }
+    local->task = false;
+    check(
+        vector_size(&local->frames) >= local->task_depth,
+        "sljex_task_end after finishing a try block entered before the task"
+    );
+    if(vector_size(&local->frames) > local->task_depth){
+        //only the profiler needs to look at the dropped frames
+        if(counter_load(&prof_enabled)){
+            for(size_t i = local->task_depth; i < vector_size(&local->frames); i++){
+                sljex_exstate * state = vector_get(&local->frames, i);
+                if(state->caught){
+                    prof_retire(state);
+                }
+            }
+        }
+        //the dropped frames are kept initialized for reuse,
+        // so nothing needs to be done per frame
+        seq_begin(local);
+        vector_truncatePooled(&local->frames, local->task_depth);
+        local->scope = local->task_scope;
+        seq_end(local);
+    }
+    arena_release(local, local->task_mark, local->task_used);
+    //transactions the task left open are discarded without rolling back
+    local->txnlen = local->task_txnlen;
+    local->txns = local->task_txns;
 }
 
 /**
-    internal function passed to vector_init that allocates a new vector in-place,
-    should not be called manually
+    frees the scope allocations made after a mark
+@post
+    the blocks filled after mark are freed (one may be kept as the spare),
+    and mark is rewound to used, NULL frees every block
+*/
+static void arena_release(sljex_thread * local, sljex_chunk * mark, size_t used) {
+    while(local->arena != mark){
+        sljex_chunk * chunk = local->arena;
+        local->arena = chunk->prev;
+        if(local->spare == NULL && chunk->size == SLJEX_SCOPE_CHUNK){
+            local->spare = chunk;
+        }else{
+            free(chunk);
+        }
+    }
+    if(mark != NULL){
+        mark->used = used;
+    }
+}
+
+/**
+    calls a function inside a try block
+@post
+    an exception thrown by fn is caught and released,
+    its code and message are stored to excode and exstr if not NULL
+@returns
+    true if fn returned normally, false if it threw
+@note
+    only this function contains the setjmp, so callers keep their locals in registers
+*/
+bool sljex_try_call(void (*fn)(void * arg), void * arg, int * excode, char const * * exstr) {
+    //volatile since it lives across the setjmp of the try (-Wclobbered),
+    // it is only assigned after the longjmp so this costs next to nothing
+    bool volatile returned = true;
+    try{
+        fn(arg);
+    }catchany{
+        returned = false;
+        if(excode != NULL){
+            *excode = sljex_excode();
+        }
+        if(exstr != NULL){
+            *exstr = sljex_exstr();
+        }
+    }finally;
+    return returned;
+}
+
+/**
+    calls a function inside a try block with a table of handlers
+@post
+    an exception thrown by fn is passed to the first entry of table
+    handling its code, and rethrown if there is none
+@returns
+    the code of the handled exception, 0 if fn returned normally
+@note
+    handlers run inside the catch, so the exception is released
+    when they return, or replaced if they throw or rethrow
+*/
+int sljex_try_handlers(void (*fn)(void * arg), void * arg, sljex_handler const * table, size_t count) {
+    //volatile since it lives across the setjmp of the try (-Wclobbered),
+    // it is only assigned after the longjmp so this costs next to nothing
+    int volatile handled = 0;
+    try{
+        fn(arg);
+    }catchany{
+        int const excode = sljex_excode();
+        size_t i = 0;
+        while(i < count && table[i].excode != 0 && table[i].excode != excode){
+            i++;
+        }
+        if(i == count){
+            rethrow;
+        }
+        handled = excode;
+        table[i].fn(arg);
+    }finally;
+    return handled;
+}
+
+/**
+    gets the faulting address of the current exception
+@pre
+    library is initialized, explicitly or by a try,
+    and the function is called inside a catch/catchany block
+@post
+    fails and calls panic if called outside catch/catchany (checked build)
+@returns
+    the address that caused the trapped signal (si_addr) for
+    EXSEGV, EXBUS and EXFPE, NULL for any other exception
+*/
+void * sljex_exaddr(void) {
+    sljex_thread * local = thread_get();
+    vector * local_vec = thread_frames(local);
+    check(
+        vector_size(local_vec) > 0 && ((sljex_exstate *)vector_getLast(local_vec))->caught,
+        "sljex_exaddr outside catch/catchany"
+    );
+    return ((sljex_exstate *)vector_getLast(local_vec))->addr;
+}
+
+/**
+    converts hardware faults inside try blocks into exceptions
 @pre
-    vecspace represents an unallocated vector slot in another vector
+    library is initialized, explicitly or by a try
 @post
-    vecspace is assigned a new valid, allocated vector instance
+    signals whose SLJEX_TRAP_ flag is set in flags are handled on an
+    alternate stack, throwing EXSEGV, EXBUS or EXFPE to the innermost
+    try block of the faulting thread, and the signals whose flag is
+    not set are returned to the actions they had before being trapped
 @returns
-    false if fails to initialize, statespace is unchanged
+    false if a signal action cannot be installed
+@note
+    a fault outside of any try block gets the signal's previous action,
+    by default terminating the process with a core dump
+@note
+    the calling thread and threads whose first try comes later get
+    an alternate stack, so faults from stack overflows can be trapped
+    on those threads too
 */
-static bool vector_vinit(void * * vecspace) {
-    //allocate memory for vector
-    vector * vp = malloc(sizeof(vector));
-    //if allocation or initialization fails,
-    // return indicating failure
-    if(vp == NULL || !vector_init(vp, sljex_exstate_vinit, sljex_exstate_vdeinit)){
-        return false;
+bool sljex_trap_signals(int flags) {
+    for(size_t i = 0; i < sizeof(trappable) / sizeof(trappable[0]); i++){
+        bool const was = traps & trappable[i].flag;
+        bool const want = flags & trappable[i].flag;
+        if(want && !was){
+            struct sigaction sa;
+            sa.sa_sigaction = trap_handler;
+            sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+            sigemptyset(&sa.sa_mask);
+            if(sigaction(trappable[i].sig, &sa, &untrapped[i])){
+                return false;
+            }
+        }else if(!want && was){
+            sigaction(trappable[i].sig, &untrapped[i], NULL);
+        }
+        counter_store(&traps, want ? traps | trappable[i].flag : traps & ~trappable[i].flag);
+    }
+    sljex_thread * local = thread_get();
+    if(flags != 0 && local != NULL){
+        thread_altstack(local);
     }
-    *vecspace = vp;
     return true;
 }
 
 /**
-    internal function passed to vector_init that deinitializes an vector instance in-place,
-    should not be called manually
+    prepares a collector for a sljex_collect block
 @pre
-    vecspace is a valid, allocated vector instance
+    errors has room for cap exceptions, or is NULL if cap is 0
 @post
-    vecspace's instance will be deinitialized and deallocated
+    the collector is empty, and if summary is true its block
+    throws EXCOLLECTED at its end when anything was collected
+*/
+void sljex_collector_init(sljex_collector * c, sljex_collected * errors, size_t cap, bool summary) {
+    c->errors = errors;
+    c->cap = cap;
+    c->count = 0;
+    c->summary = summary;
+    c->index = 0;
+    c->depth_ = 0;
+}
+
+/**
+    internal function used in the sljex_collect macro,
+    not meant to be called directly
+@pre
+    library is initialized, explicitly or by a try
+@post
+    a new exstate is pushed like sljex_trybuf_, which records the
+    exceptions delivered to it in c instead of being caught
+@returns
+    always 1, to enter the block
+*/
+int sljex_collect_begin_(sljex_collector * c) {
+    sljex_thread * local = thread_get();
+    if(local == NULL){
+        local = thread_register();
+    }
+    sljex_exstate * local_state = exstate_push(local);
+    local_state->collector = c;
+    c->depth_ = vector_size(&local->frames);
+    c->index = 0;
+    c->count = 0;
+    return 1;
+}
+
+/**
+    internal function used in the sljex_collect macro,
+    not meant to be called directly
+@pre
+    called right after sljex_collect_begin_
+@returns
+    the jmp_buf of the collector's exstate, which every collected
+    exception jumps back to
 */
-static void vector_vdeinit(void * * vecspace) {
-    vector_deinit(*vecspace);
-    free(*vecspace);
+jmp_buf_ptr sljex_collectbuf_(sljex_collector * c) {
+    sljex_thread * local = thread_get();
+    return ((sljex_exstate *)vector_get(&local->frames, c->depth_ - 1))->jb;
+}
+
+/**
+    internal function used in the sljex_collect macro,
+    not meant to be called directly
+@pre
+    called once the loop of a sljex_collect block is done
+@post
+    the collector's exstate is popped, and EXCOLLECTED is thrown
+    if the collector asked for a summary and anything was collected
+@returns
+    always 0, to leave the block
+*/
+int sljex_collect_end_(sljex_collector * c) {
+    sljex_finally_(c->depth_);
+    if(c->summary && c->count > 0){
+        throwWithMsg(EXCOLLECTED, c->cap > 0 ? c->errors[0].exstr : "EXCOLLECTED");
+    }
+    return 0;
+}
+
+/**
+    internal function used in the sljex_deadline macro,
+    not meant to be called directly
+@pre
+    library is initialized, explicitly or by a try
+@post
+    a new exstate is pushed like sljex_trybuf_ and becomes the
+    innermost scope, with a deadline ns nanoseconds from now,
+    or the deadline of the enclosing scope if that is sooner
+*/
+jmp_buf_ptr sljex_deadlinebuf_(size_t * depth, unsigned long long ns) {
+    sljex_thread * local = thread_get();
+    if(local == NULL){
+        local = thread_register();
+    }
+    sljex_exstate * local_state = exstate_push(local);
+    *depth = vector_size(&local->frames);
+    //a deadline too far away to represent never expires
+    unsigned long long const now = prof_now();
+    unsigned long long deadline = ns < ULLONG_MAX - now ? now + ns : ULLONG_MAX;
+    if(local->scope != NULL && local->scope->deadline != 0 && local->scope->deadline < deadline){
+        deadline = local->scope->deadline;
+    }
+    local_state->scope = true;
+    local_state->deadline = deadline;
+    local_state->cancel = NULL;
+    local_state->outer = local->scope;
+    local->scope = local_state;
+    return local_state->jb;
+}
+
+/**
+    internal function used in the sljex_cancel_scope macro,
+    not meant to be called directly
+@pre
+    library is initialized, explicitly or by a try,
+    token stays valid until the scope's finally
+@post
+    a new exstate is pushed like sljex_trybuf_ and becomes the
+    innermost scope, cancelled through token,
+    and inheriting the deadline of the enclosing scope
+*/
+jmp_buf_ptr sljex_cancelbuf_(size_t * depth, sljex_cancel * token) {
+    sljex_thread * local = thread_get();
+    if(local == NULL){
+        local = thread_register();
+    }
+    sljex_exstate * local_state = exstate_push(local);
+    *depth = vector_size(&local->frames);
+    local_state->scope = true;
+    local_state->deadline = local->scope != NULL ? local->scope->deadline : 0;
+    local_state->cancel = token;
+    local_state->outer = local->scope;
+    local->scope = local_state;
+    return local_state->jb;
+}
+
+/**
+    throws EXTIMEOUT or EXCANCELLED if the current thread is
+    inside a deadline scope that expired or a cancellation scope
+    that was cancelled
+@pre
+    library is initialized, explicitly or by a try
+@post
+    returns without doing anything outside of scopes,
+    only reads the clock if a deadline is active
+@note
+    the exception is thrown to the innermost try block like throw,
+    so try blocks between the checkpoint and the scope must rethrow it
+@note
+    scopes whose exception is already caught are skipped,
+    since their catch blocks are no longer inside the scope
+*/
+void sljex_checkpoint(void) {
+    sljex_thread * local = thread_get();
+    if(local == NULL || local->scope == NULL){
+        return;
+    }
+    //deadlines are inherited, so only the innermost
+    // uncaught scope's deadline needs to be compared
+    bool timed = false;
+    for(sljex_exstate * scope = local->scope; scope != NULL; scope = scope->outer){
+        if(scope->caught){
+            continue;
+        }
+        if(!timed){
+            timed = true;
+            if(scope->deadline != 0 && prof_now() >= scope->deadline){
+                throw(EXTIMEOUT);
+            }
+        }
+        if(scope->cancel != NULL && __atomic_load_n(&scope->cancel->cancelled, __ATOMIC_RELAXED)){
+            throw(EXCANCELLED);
+        }
+    }
+}
+
+/**
+    requests cancellation of every scope using token
+@post
+    the next sljex_checkpoint inside such a scope throws EXCANCELLED,
+    may be called from any thread
+*/
+void sljex_cancel_request(sljex_cancel * token) {
+    __atomic_store_n(&token->cancelled, 1, __ATOMIC_RELAXED);
+}
+
+/**
+    clears a cancellation request so token can be reused
+@pre
+    no other thread is requesting cancellation through token
+*/
+void sljex_cancel_reset(sljex_cancel * token) {
+    __atomic_store_n(&token->cancelled, 0, __ATOMIC_RELAXED);
+}
+
+/**
+    reads the exception stack of one thread record
+@pre
+    the registry is locked, so the record and the memory
+    of its frames cannot be freed during the read
+@returns
+    false if the owner kept modifying its frames for every attempt
+*/
+static bool snapshot_thread(sljex_thread * local, sljex_threadsnap * snap) {
+    for(int attempt = 0; attempt < SLJEX_SNAPSHOT_RETRIES; attempt++){
+        unsigned const seq = __atomic_load_n(&local->seq, __ATOMIC_ACQUIRE);
+        //the owner is in the middle of a modification
+        if(seq & 1){
+            continue;
+        }
+        size_t const depth = __atomic_load_n(&local->frames.count, __ATOMIC_RELAXED);
+        void * * const data = __atomic_load_n(&local->frames.data, __ATOMIC_RELAXED);
+        snap->depth = depth;
+        snap->count = depth < SLJEX_SNAPSHOT_FRAMES ? depth : SLJEX_SNAPSHOT_FRAMES;
+        //frames are listed innermost first
+        for(size_t i = 0; i < snap->count; i++){
+            sljex_exstate * state = __atomic_load_n(&data[depth - 1 - i], __ATOMIC_RELAXED);
+            snap->frames[i].excode = __atomic_load_n(&state->excode, __ATOMIC_RELAXED);
+            snap->frames[i].exstr = __atomic_load_n(&state->exstr, __ATOMIC_RELAXED);
+            snap->frames[i].caught = __atomic_load_n(&state->caught, __ATOMIC_RELAXED);
+            snap->frames[i].site = __atomic_load_n(&state->site, __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&local->seq, __ATOMIC_RELAXED) == seq){
+            //fields of a frame without an exception are leftovers of its previous use
+            for(size_t i = 0; i < snap->count; i++){
+                if(snap->frames[i].excode == 0){
+                    snap->frames[i].exstr = NULL;
+                    snap->frames[i].site = NULL;
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+    takes a snapshot of the exception stacks of every thread
+    that has used the library, without stopping them
+@pre
+    library is initialized, explicitly or by a try,
+    out has room for at least max thread snapshots
+@post
+    out holds up to max thread snapshots, in registration order
+@returns
+    the total number of registered threads, which may be greater than max
+@note
+    threads are never blocked, a reader retries while a thread is
+    modifying its stack, and gives up on a thread after
+    SLJEX_SNAPSHOT_RETRIES attempts, marking its snapshot inconsistent.
+    only frame memory being freed (stacks shrinking) waits for the reader
+@note
+    exstr pointers are copied as-is, the strings belong to the throwing code
+*/
+size_t sljex_snapshot_all(sljex_threadsnap * out, size_t max) {
+    pthread_mutex_lock(&mtx);
+    size_t const count = vector_size(&global_local_vec_holder);
+    for(size_t i = 0; i < count && i < max; i++){
+        sljex_thread * local = vector_get(&global_local_vec_holder, i);
+        out[i].thread = local->id;
+        out[i].consistent = snapshot_thread(local, &out[i]);
+        if(!out[i].consistent){
+            out[i].depth = out[i].count = 0;
+        }
+    }
+    pthread_mutex_unlock(&mtx);
+    return count;
+}
+
+/**
+    sets how many pops an exception stack must spend below a quarter
+    of its capacity before the capacity is halved
+@post
+    applies to every thread, 0 disables shrinking unless
+    the memory budget is exceeded
+@note
+    defaults to SLJEX_SHRINK_DEFAULT
+*/
+void sljex_set_shrink_threshold(size_t pops) {
+    counter_store(&frames_budget.shrinkAfter, pops);
+}
+
+/**
+    sets a process-wide soft limit on the capacity held by exception stacks
+@post
+    while more than bytes are held, stacks shrink on the first pop
+    that leaves them below a quarter of their capacity,
+    without waiting for the shrink threshold,
+    0 removes the limit
+*/
+void sljex_set_memory_budget(size_t bytes) {
+    counter_store(&frames_budget.limit, bytes);
+}
+
+/**
+    gets the capacity held by the exception stacks of all threads
+@returns
+    the number of bytes reserved for exception stacks,
+    including the exstates retained for reuse
+*/
+size_t sljex_memory_usage(void) {
+    return counter_load(&frames_budget.used);
+}
+
+/**
+    enables or disables per-site profiling of exceptions
+@post
+    exceptions thrown while enabled are counted against their throw site,
+    and their catch distance and latency are recorded once they are handled
+@note
+    exceptions already in flight keep the profiling state they were thrown with
+*/
+void sljex_profile_enable(bool enable) {
+    counter_store(&prof_enabled, enable);
+}
+
+/**
+    clears the counters and histograms of every profiled site
+@pre
+    library is initialized, explicitly or by a try
+@note
+    sites stay registered, so they are still reported with zero counts
+*/
+void sljex_profile_reset(void) {
+    pthread_mutex_lock(&mtx);
+    prof_clear();
+    pthread_mutex_unlock(&mtx);
+}
+
+/**
+    clears the counters and histograms of every profiled site
+@pre
+    mtx is held
+*/
+static void prof_clear(void) {
+    for(sljex_siteprof_node * node = prof_sites; node != NULL; node = node->next){
+        sljex_siteprof * p = &node->prof;
+        counter_store(&p->throws, 0);
+        counter_store(&p->rethrows, 0);
+        counter_store(&p->handled, 0);
+        counter_store(&p->frames_total, 0);
+        counter_store(&p->ns_total, 0);
+        for(size_t i = 0; i < SLJEX_PROF_BUCKETS; i++){
+            counter_store(&p->frames[i], 0);
+            counter_store(&p->ns[i], 0);
+        }
+    }
+}
+
+///orders site profiles by descending throw count for qsort
+static int prof_compare(void const * a, void const * b) {
+    unsigned long const ta = ((sljex_siteprof const *)a)->throws;
+    unsigned long const tb = ((sljex_siteprof const *)b)->throws;
+    return (ta < tb) - (ta > tb);
+}
+
+/**
+    takes a snapshot of the hottest throw sites
+@pre
+    library is initialized, explicitly or by a try,
+    out has room for at least max site profiles
+@post
+    out holds up to max site profiles ordered by descending throw count
+@returns
+    the total number of profiled sites, which may be greater than max
+@note
+    counters are read individually while other threads keep throwing,
+    so a snapshot is not an atomic view of all sites
+*/
+size_t sljex_profile_report(sljex_siteprof * out, size_t max) {
+    pthread_mutex_lock(&mtx);
+    size_t count = 0;
+    for(sljex_siteprof_node * node = prof_sites; node != NULL; node = node->next){
+        count++;
+    }
+    //snapshot every site so the hottest can be selected
+    sljex_siteprof * all = malloc((count ? count : 1) * sizeof(sljex_siteprof));
+    if(all == NULL){
+        pthread_mutex_unlock(&mtx);
+        return 0;
+    }
+    size_t i = 0;
+    for(sljex_siteprof_node * node = prof_sites; node != NULL; node = node->next, i++){
+        sljex_siteprof const * p = &node->prof;
+        all[i].file = p->file;
+        all[i].func = p->func;
+        all[i].line = p->line;
+        all[i].throws = counter_load(&p->throws);
+        all[i].rethrows = counter_load(&p->rethrows);
+        all[i].handled = counter_load(&p->handled);
+        all[i].frames_total = counter_load(&p->frames_total);
+        all[i].ns_total = counter_load(&p->ns_total);
+        for(size_t b = 0; b < SLJEX_PROF_BUCKETS; b++){
+            all[i].frames[b] = counter_load(&p->frames[b]);
+            all[i].ns[b] = counter_load(&p->ns[b]);
+        }
+    }
+    pthread_mutex_unlock(&mtx);
+    
+    qsort(all, count, sizeof(sljex_siteprof), prof_compare);
+    for(i = 0; i < count && i < max; i++){
+        out[i] = all[i];
+    }
+    free(all);
+    return count;
+}
+
+/**
+    prints the hottest throw sites as a table
+@pre
+    library is initialized, explicitly or by a try
+@post
+    one line per site is written to f, hottest first,
+    averages are taken over handled exceptions
+*/
+void sljex_profile_print(FILE * f, size_t max) {
+    sljex_siteprof * sites = malloc((max ? max : 1) * sizeof(sljex_siteprof));
+    if(sites == NULL){
+        return;
+    }
+    size_t const count = sljex_profile_report(sites, max);
+    fprintf(f, "%10s %10s %10s %10s %12s  %s\n",
+        "throws", "rethrows", "handled", "avg frames", "avg ns", "site");
+    for(size_t i = 0; i < count && i < max; i++){
+        sljex_siteprof const * p = &sites[i];
+        double const handled = p->handled ? (double)p->handled : 1.0;
+        fprintf(f, "%10lu %10lu %10lu %10.2f %12.0f  %s:%d (%s)\n",
+            p->throws, p->rethrows, p->handled,
+            p->frames_total / handled, p->ns_total / handled,
+            p->file, p->line, p->func);
+    }
+    free(sites);
+}
+
+///reads the monotonic clock in nanoseconds
+static unsigned long long prof_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+///maps a value to its logarithmic histogram bucket
+static size_t prof_bucket(unsigned long long value) {
+    size_t bucket = 0;
+    while(value != 0 && bucket < SLJEX_PROF_BUCKETS - 1){
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/**
+    allocates the profiling data of a site
+@returns
+    NULL if it cannot be allocated
+@note
+    the site's strings are copied since the site belongs to a module
+    that may be unloaded while the library keeps its profile
+*/
+static sljex_siteprof_node * prof_node(sljex_site const * site) {
+    char const * const file = site->file != NULL ? site->file : "";
+    char const * const func = site->func != NULL ? site->func : "";
+    size_t const filelen = strlen(file) + 1;
+    size_t const funclen = strlen(func) + 1;
+    sljex_siteprof_node * node = calloc(1, sizeof(sljex_siteprof_node) + filelen + funclen);
+    if(node == NULL){
+        return NULL;
+    }
+    memcpy(node->names, file, filelen);
+    memcpy(node->names + filelen, func, funclen);
+    node->prof.file = node->names;
+    node->prof.func = node->names + filelen;
+    node->prof.line = site->line;
+    return node;
+}
+
+/**
+    gets the profiling data of a site, registering the site on first use
+@pre
+    library is initialized, explicitly or by a try
+@returns
+    NULL if the profiling data cannot be allocated
+@note
+    only the first throw from a site takes the global mutex
+*/
+static sljex_siteprof * prof_site(sljex_site * site) {
+    sljex_siteprof_node * node = __atomic_load_n((sljex_siteprof_node * *)&site->prof, __ATOMIC_ACQUIRE);
+    if(node == NULL){
+        pthread_mutex_lock(&mtx);
+        //another thread may have registered the site in the meantime
+        node = site->prof;
+        if(node == NULL && (node = prof_node(site)) != NULL){
+            node->next = prof_sites;
+            prof_sites = node;
+            __atomic_store_n((sljex_siteprof_node * *)&site->prof, node, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&mtx);
+        if(node == NULL){
+            return NULL;
+        }
+    }
+    return &node->prof;
+}
+
+/**
+    records the origin of a newly thrown exception
+@post
+    state starts profiling the exception if profiling is enabled
+*/
+static void prof_throw(sljex_exstate * state, sljex_site * site) {
+    state->site = site;
+    state->frames = 1;
+    state->profiled = counter_load(&prof_enabled);
+    if(state->profiled){
+        sljex_siteprof * prof = prof_site(site);
+        if(prof != NULL){
+            counter_add(&prof->throws, 1);
+        }
+        state->thrown = prof_now();
+    }
+}
+
+/**
+    records a caught exception whose exstate is being released
+@pre
+    state has been caught
+*/
+static void prof_retire(sljex_exstate * state) {
+    if(!state->profiled){
+        return;
+    }
+    sljex_siteprof * prof = prof_site(state->site);
+    if(prof == NULL){
+        return;
+    }
+    counter_add(&prof->handled, 1);
+    counter_add(&prof->frames_total, state->frames);
+    counter_add(&prof->ns_total, state->ns);
+    counter_add(&prof->frames[prof_bucket(state->frames)], 1);
+    counter_add(&prof->ns[prof_bucket(state->ns)], 1);
+}
+
+/**
+    registers the current thread with the library
+@pre
+    the current thread has no record in the current generation
+@post
+    panics if mutex cannot be locked or thread local storage cannot be set,
+    otherwise the library is initialized if it was not,
+    and a new thread record is pushed to the global stack
+@returns
+    the current thread's new record
+@note
+    the library should be properly deinitialized even upon failure
+*/
+static sljex_thread * thread_register(void) {
+    if(pthread_mutex_lock(&mtx)){
+        panic("sljex: failed to lock mutex.\n");
+    }
+    //the first try of the process initializes the library,
+    // which then stays initialized until it is unloaded
+    if(unlikely(!initialized)){
+        if(!setup()){
+            pthread_mutex_unlock(&mtx);
+            panic("sljex: failed to initialize.\n");
+        }
+        pinned = true;
+    }
+    //panic if adding a new default-initialized
+    // record to the global stack fails
+    if(!vector_pushInit(&global_local_vec_holder)){
+        //exit runs the sljex_unload destructor,
+        // which skips the teardown while the mutex is held
+        pthread_mutex_unlock(&mtx);//should be impossible to fail if lock succeeded
+        panic("sljex: failed to allocate exception vector.\n");
+    }
+    //get a reference to the new record instance
+    sljex_thread * local = vector_getLast(&global_local_vec_holder);
+    //panic if setting threadlocal storage to
+    // the new record instance reference fails,
+    if(pthread_setspecific(tlthread, local)){
+        //exit runs the sljex_unload destructor,
+        // which skips the teardown while the mutex is held
+        pthread_mutex_unlock(&mtx);//should be impossible to fail if lock succeeded
+        panic("sljex: failed to initalize threadlocal exception vector.\n");
+    }
+    thread_setgen();
+    pthread_mutex_unlock(&mtx);//should be impossible to fail if lock succeeded
+    if(counter_load(&traps) != 0){
+        thread_altstack(local);
+    }
+    return local;
+}
+
+/**
+    pushes a new exstate for a try onto a thread's stack
+@post
+    panics if the exstate cannot be allocated
+@returns
+    the new exstate
+*/
+static sljex_exstate * exstate_push(sljex_thread * local) {
+    seq_begin(local);
+    //reuse a previously popped exstate instance or create a new one,
+    // and panic if initialization fails
+    if(!vector_pushPooled(&local->frames)){
+        panic("sljex: failed to initalize threadlocal exception state.\n");
+    }
+    //obtain reference to the exstate instance and
+    // reset it to show that it does not currently hold an exception
+    sljex_exstate * local_state = vector_getLast(&local->frames);
+    local_state->excode = 0;//excode 0 means not-an-exception
+    local_state->caught = false;
+    local_state->profiled = false;
+    local_state->scope = false;
+    local_state->collector = NULL;
+    local_state->root = false;
+    local_state->txn = false;
+    local_state->marked = false;
+    seq_end(local);
+    return local_state;
+}
+
+/**
+    pops the innermost exstate of a thread without releasing anything
+@pre
+    the thread's stack holds at least two exstates
+@post
+    like exstate_pop, except that the stack is not shrunk and the
+    exstate's scope allocations are handed to the enclosing exstate
+@note
+    async-signal-safe, used by trap_handler
+*/
+static void exstate_drop(sljex_thread * local) {
+    sljex_exstate * local_state = vector_getLast(&local->frames);
+    if(local_state->scope){
+        local->scope = local_state->outer;
+    }
+    if(local_state->txn && --local->txns == 0){
+        local->txnlen = 0;
+    }
+    seq_begin(local);
+    vector_popPooledNoShrink(&local->frames);
+    seq_end(local);
+    sljex_exstate * outer = vector_getLast(&local->frames);
+    if(local_state->marked && !outer->marked){
+        outer->marked = true;
+        outer->mark = local_state->mark;
+        outer->mark_used = local_state->mark_used;
+    }
+}
+
+/**
+    pops and releases the innermost exstate of a thread
+@pre
+    the thread's stack is not empty
+@post
+    if the exstate was a scope, the enclosing scope becomes the innermost one
+*/
+static void exstate_pop(sljex_thread * local) {
+    sljex_exstate * local_state = vector_getLast(&local->frames);
+    if(local_state->scope){
+        local->scope = local_state->outer;
+    }
+    if(local_state->marked){
+        arena_release(local, local_state->mark, local_state->mark_used);
+    }
+    //the outermost transaction finishing commits everything logged,
+    // a rolled back one has already emptied its part of the log
+    if(local_state->txn && --local->txns == 0){
+        local->txnlen = 0;
+    }
+    //the exstate is kept for reuse rather than freed,
+    // so snapshot readers never see it disappear under them
+    seq_begin(local);
+    vector_popPooled(&local->frames);
+    seq_end(local);
+}
+
+#ifdef SLJEX_CHECKED
+/**
+    reports a misuse of the library along with the
+    current thread's exception stack, and exits
+@note
+    only part of the checked build
+*/
+static void misuse(char const * what) {
+    sljex_thread * local = thread_get();
+    vector * local_vec = thread_frames(local);
+    size_t const depth = vector_size(local_vec);
+    fprintf(stderr, "sljex: %s.\n", what);
+    fprintf(stderr, "sljex:   %zu active try block(s), innermost first:\n", depth);
+    for(size_t i = depth; i > 0; i--){
+        sljex_exstate const * state = vector_get(local_vec, i - 1);
+        if(state->excode == 0){
+            fprintf(stderr, "sljex:   #%zu no exception\n", depth - i);
+        }else{
+            fprintf(stderr, "sljex:   #%zu %s \"%s\"(%d) thrown at %s:%d (%s)\n",
+                depth - i, state->caught ? "caught" : "uncaught",
+                state->exstr, state->excode,
+                state->site->file, state->site->line, state->site->func);
+        }
+    }
+    exit(EXIT_FAILURE);
+}
+#endif
+
+/**
+    fork handler run in the forking thread before fork
+@post
+    the registry mutex is held across fork, so no other thread
+    can be in the middle of modifying the registry when the
+    child's copy of the process is taken
+*/
+static void fork_prepare(void) {
+    pthread_mutex_lock(&mtx);
+}
+
+/**
+    fork handler run in the parent after fork
+@post
+    the registry mutex taken by fork_prepare is released
+*/
+static void fork_parent(void) {
+    pthread_mutex_unlock(&mtx);
+}
+
+/**
+    fork handler run in the child after fork
+@post
+    the records of every thread except the forking one are released,
+    since those threads do not exist in the child,
+    and the registry mutex taken by fork_prepare is released
+@note
+    the forking thread keeps its exception stack,
+    so try blocks it is inside of still work in the child
+*/
+static void fork_child(void) {
+    if(!initialized){
+        pthread_mutex_unlock(&mtx);
+        return;
+    }
+    sljex_thread * local = thread_get();
+    for(size_t i = 0; i < vector_size(&global_local_vec_holder); i++){
+        void * record = vector_get(&global_local_vec_holder, i);
+        if(record != local){
+            //the thread does not exist in the child,
+            // so nothing has its alternate stack installed
+            free(((sljex_thread *)record)->altstack);
+            ((sljex_thread *)record)->altstack = NULL;
+            sljex_thread_vdeinit(&record);
+        }
+    }
+    //rebuild the registry with only the forking thread's record,
+    // vector_push cannot fail since the capacity is already there
+    while(vector_size(&global_local_vec_holder) > 0){
+        vector_pop(&global_local_vec_holder);
+    }
+    if(local != NULL){
+        vector_push(&global_local_vec_holder, local);
+        local->id = pthread_self();
+        //the journal mapping is shared with the parent,
+        // the child claims a region of its own on its next event
+        local->journal = NULL;
+        local->journal_gen = 0;
+    }
+    pthread_mutex_unlock(&mtx);
+}
+
+/**
+    records an exception delivered to the exstate of a sljex_collect block
+@pre
+    local_state is the innermost exstate and has a collector
+@post
+    the exception is appended to the collector's buffer if there is room,
+    and the collector resumes at the item after the one that threw
+@returns
+    the jmp_buf of the collector's exstate
+@note
+    the exstate is left without an exception, no catch is needed
+*/
+static jmp_buf_ptr collect(sljex_exstate * local_state, int excode, char const * exstr) {
+    sljex_collector * c = local_state->collector;
+    if(c->count < c->cap){
+        c->errors[c->count].excode = excode;
+        c->errors[c->count].exstr = exstr;
+        c->errors[c->count].index = c->index;
+    }
+    c->count++;
+    c->index++;
+    //a collected exception counts as handled right away
+    if(local_state->profiled){
+        local_state->ns = 0;
+        prof_retire(local_state);
+        local_state->profiled = false;
+    }
+    return local_state->jb;
+}
+
+#ifdef SLJEX_ENGINE_UNWIND
+///identifies exceptions of this library to other unwinders ("SLJXEX\0\0")
+#define SLJEX_EXCEPTION_CLASS ((_Unwind_Exception_Class)0x534C4A5845580000ull)
+
+/**
+    stop function of the forced unwind started by sljex_unwind_
+@post
+    lets the unwinder run the cleanups of every frame inside the try block,
+    and jumps to the landing pad once it reaches the function
+    containing the try block, or the end of the stack
+@note
+    stack frames of functions called from inside the try block
+    have a canonical frame address no higher than the frame address
+    recorded by the try, while the function containing it has a higher one
+*/
+static _Unwind_Reason_Code unwind_stop(
+    int version, _Unwind_Action actions, _Unwind_Exception_Class exclass,
+    struct _Unwind_Exception * exobj, struct _Unwind_Context * context, void * landing
+) {
+    (void)version;
+    (void)exclass;
+    (void)exobj;
+    if((actions & _UA_END_OF_STACK)
+    || _Unwind_GetCFA(context) > (_Unwind_Ptr)((void * *)landing)[SLJEX_FRAME_SLOT_]){
+        __builtin_longjmp(landing, 1);
+    }
+    return _URC_NO_REASON;
+}
+
+/**
+    internal function used by the throwing macros of the unwind engine,
+    not meant to be called directly
+@pre
+    landing is the landing pad returned by sljex_throwbuf_ or sljex_rethrowbuf_
+@post
+    the stack is unwound up to the landing pad, running cleanups,
+    and execution continues there, never returns
+*/
+void sljex_unwind_(jmp_buf_ptr landing) {
+    //the thread has a landing pad, so its record is current
+    sljex_thread * local = pthread_getspecific(tlthread);
+    //the exception object only needs to identify the library
+    memset(&local->unwind, 0, sizeof(local->unwind));
+    local->unwind.exception_class = SLJEX_EXCEPTION_CLASS;
+    _Unwind_ForcedUnwind(&local->unwind, unwind_stop, landing);
+    //the unwinder could not walk the stack (missing unwind tables),
+    // jump to the landing pad without running cleanups
+    __builtin_longjmp(landing, 1);
+}
+#endif
+
+/**
+    handles an unhandled exception
+@pre
+    below is the number of the thread's frames that are not part of
+    the unhandled exception's path, and may be used to recover
+@post
+    never returns: if the terminate handler asks for recovery and
+    one of the frames below is an active sljex_recover block,
+    the frames above it are released and the exception is delivered to it,
+    otherwise the process exits
+*/
+static void terminate(sljex_thread * local, size_t below, int excode, char const * exstr, sljex_site * site) {
+    if(journal != NULL){
+        journal_write(local, SLJEX_JOURNAL_UNHANDLED, excode, exstr, site);
+    }
+    sljex_terminate_handler handler = local != NULL ? local->terminate : NULL;
+    if(handler == NULL){
+        handler = __atomic_load_n(&terminate_handler, __ATOMIC_ACQUIRE);
+    }
+    if(handler != NULL && handler(excode, exstr) == SLJEX_TERMINATE_RECOVER){
+        //the innermost recovery point whose catch blocks are not running yet
+        for(size_t i = below; i > 0; i--){
+            sljex_exstate * root = vector_get(&local->frames, i - 1);
+            if(root->root && !root->caught){
+                SLJEX_LONGJMP_(deliver(local, i - 1, excode, exstr, site));
+            }
+        }
+    }
+    panic("sljex_terminate: unhandled \"%s\"(%d) thrown.\n", exstr, excode);
+}
+
+/**
+    delivers an exception directly to a frame below the innermost one
+@pre
+    index is the position of an uncaught frame on the thread's stack
+@post
+    the frames above it are released, rolling back the transactions
+    among them, and the exception is assigned to it without being profiled
+@returns
+    the jmp_buf of the frame
+*/
+static jmp_buf_ptr deliver(sljex_thread * local, size_t index, int excode, char const * exstr, sljex_site * site) {
+    while(vector_size(&local->frames) > index + 1){
+        sljex_exstate * top = vector_getLast(&local->frames);
+        if(top->txn){
+            txn_rollback(local, top->txn_start);
+        }
+        exstate_pop(local);
+    }
+    sljex_exstate * local_state = vector_getLast(&local->frames);
+    if(local_state->txn){
+        txn_rollback(local, local_state->txn_start);
+    }
+    seq_begin(local);
+    local_state->excode = excode;
+    local_state->exstr = exstr;
+    local_state->addr = NULL;
+    local_state->site = site;
+    local_state->profiled = false;
+    seq_end(local);
+    return local_state->jb;
+}
+
+/**
+    starts journaling into a new file
+@pre
+    library is initialized, explicitly or by a try,
+    no other thread may throw during the call
+@post
+    the file at path is replaced by an empty journal of threads regions,
+    each holding the last events events of the thread that claims it,
+    and a previously opened journal is closed
+@returns
+    false if the file cannot be created or mapped,
+    journaling is then disabled
+*/
+bool sljex_journal_open(char const * path, size_t threads, size_t events) {
+    sljex_journal_close();
+    if(threads == 0 || events == 0 || threads > UINT32_MAX || events >= UINT32_MAX){
+        return false;
+    }
+    //each ring has a spare slot for the event being written,
+    // so a crash mid-write never tears one of the last events events
+    size_t const region = sizeof(sljex_journal_region) + (events + 1) * sizeof(sljex_journal_event);
+    size_t const size = sizeof(sljex_journal_header) + threads * region;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1){
+        return false;
+    }
+    //the file is extended with zeros, so every region starts out empty
+    if(ftruncate(fd, size)){
+        close(fd);
+        return false;
+    }
+    void * map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED){
+        return false;
+    }
+    sljex_journal_header * header = map;
+    memcpy(header->magic, SLJEX_JOURNAL_MAGIC, sizeof(header->magic));
+    header->version = SLJEX_JOURNAL_VERSION;
+    header->slots = events + 1;
+    header->regions = threads;
+    header->claimed = 0;
+    journal_size = size;
+    if(++journal_gen == 0){
+        journal_gen = 1;
+    }
+    __atomic_store_n(&journal, header, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+    stops journaling
+@pre
+    no other thread may throw during the call
+@post
+    the journal file is unmapped, the events written stay in the file
+*/
+void sljex_journal_close(void) {
+    sljex_journal_header * header = journal;
+    if(header == NULL){
+        return;
+    }
+    __atomic_store_n(&journal, NULL, __ATOMIC_RELEASE);
+    munmap(header, journal_size);
+}
+
+///copies a string into a fixed size journal field, truncating it
+static void journal_copy(char * dst, size_t size, char const * src) {
+    if(src == NULL){
+        return;
+    }
+    size_t len = strlen(src);
+    if(len >= size){
+        len = size - 1;
+    }
+    memcpy(dst, src, len);
+}
+
+/**
+    appends an event to the journal region of the current thread
+@pre
+    a journal is open
+@post
+    the thread claims a region on its first event,
+    the event is dropped if every region is already claimed
+@note
+    only plain stores are made, and the region's head is published after the event,
+    which goes in the slot of the oldest event of a full ring,
+    so readers must skip that slot to never show a half written event
+*/
+static void journal_write(sljex_thread * local, int kind, int excode, char const * exstr, sljex_site const * site) {
+    sljex_journal_header * header = __atomic_load_n(&journal, __ATOMIC_ACQUIRE);
+    if(header == NULL){
+        return;
+    }
+    //exceptions thrown outside of any try may come from unregistered threads
+    if(local == NULL){
+        local = thread_register();
+    }
+    if(local->journal_gen != journal_gen){
+        local->journal_gen = journal_gen;
+        uint32_t const index = __atomic_fetch_add(&header->claimed, 1, __ATOMIC_RELAXED);
+        if(index < header->regions){
+            size_t const region = sizeof(sljex_journal_region) + header->slots * sizeof(sljex_journal_event);
+            local->journal = (sljex_journal_region *)((char *)(header + 1) + index * region);
+            local->journal->pid = getpid();
+            local->journal->thread = (uint64_t)local->id;
+        }else{
+            local->journal = NULL;
+        }
+    }
+    sljex_journal_region * region = local->journal;
+    if(region == NULL){
+        return;
+    }
+    uint64_t const head = region->head;
+    sljex_journal_event * event = (sljex_journal_event *)(region + 1) + head % header->slots;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    memset(event, 0, sizeof(*event));
+    event->ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    event->kind = kind;
+    event->excode = excode;
+    event->depth = vector_size(&local->frames);
+    journal_copy(event->exstr, sizeof(event->exstr), exstr);
+    if(site != NULL){
+        event->line = site->line;
+        journal_copy(event->file, sizeof(event->file), site->file);
+        journal_copy(event->func, sizeof(event->func), site->func);
+    }
+    __atomic_store_n(&region->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+    installs an alternate signal stack for the current thread
+@pre
+    local is the current thread's record
+@post
+    the thread has an alternate signal stack, unless it already
+    had one of its own or the allocation failed,
+    and one the library installed before a teardown is taken back
+*/
+static void thread_altstack(sljex_thread * local) {
+    stack_t current;
+    if(local->altstack != NULL || sigaltstack(NULL, &current)){
+        return;
+    }
+    if(!(current.ss_flags & SS_DISABLE)){
+        //the stack may be the thread's own from before a teardown
+        pthread_mutex_lock(&mtx);
+        for(size_t i = 0; i < stray_count; i++){
+            if(stray_altstacks[i] == current.ss_sp){
+                local->altstack = current.ss_sp;
+                stray_altstacks[i] = stray_altstacks[--stray_count];
+                break;
+            }
+        }
+        pthread_mutex_unlock(&mtx);
+        return;
+    }
+    stack_t const altstack = {.ss_sp = malloc(SLJEX_ALTSTACK_SIZE), .ss_size = SLJEX_ALTSTACK_SIZE};
+    if(altstack.ss_sp != NULL && sigaltstack(&altstack, NULL) == 0){
+        local->altstack = altstack.ss_sp;
+    }else{
+        free(altstack.ss_sp);
+    }
+}
+
+/**
+    signal handler of the trapped signals
+@post
+    delivers the signal's exception with the faulting address
+    to the innermost try block, or, outside of any try block,
+    passes the signal to its previous action
+@note
+    a fault inside a catch block goes to the enclosing try block,
+    like a throw from there
+@note
+    only async-signal-safe work is done, since the fault may come from
+    inside malloc or while the thread holds the registry: nothing is
+    locked, freed, shrunk or profiled, and the unwind engine jumps
+    to the try block without running cleanups
+*/
+static void trap_handler(int sig, siginfo_t * info, void * context) {
+    size_t i = 0;
+    while(trappable[i].sig != sig){
+        i++;
+    }
+    sljex_thread * local = thread_get();
+    vector * local_vec = thread_frames(local);
+    size_t depth = vector_size(local_vec);
+    if(depth > 0 && ((sljex_exstate *)vector_getLast(local_vec))->caught){
+        depth--;
+    }
+    if(depth == 0){
+        trap_chain(i, sig, info, context);
+        return;
+    }
+    //the exception of a faulting catch block is discarded, like a throw from it
+    if(((sljex_exstate *)vector_getLast(local_vec))->caught){
+        exstate_drop(local);
+    }
+    sljex_exstate * local_state = vector_getLast(local_vec);
+    SLJEX_SITE_(site);
+    if(journal != NULL){
+        journal_write(local, SLJEX_JOURNAL_THROW, trappable[i].excode, trappable[i].exstr, &site);
+    }
+    jmp_buf_ptr jb;
+    if(local_state->collector != NULL){
+        local_state->profiled = false;
+        jb = collect(local_state, trappable[i].excode, trappable[i].exstr);
+    }else{
+        if(local_state->txn){
+            txn_rollback(local, local_state->txn_start);
+        }
+        seq_begin(local);
+        local_state->excode = trappable[i].excode;
+        local_state->exstr = trappable[i].exstr;
+        local_state->addr = info->si_addr;
+        local_state->site = &site;
+        local_state->frames = 1;
+        local_state->profiled = false;
+        seq_end(local);
+        jb = local_state->jb;
+    }
+    //the signal is blocked while its handler runs,
+    // and jumping out of the handler does not unblock it
+    sigset_t unblock;
+    sigemptyset(&unblock);
+    sigaddset(&unblock, sig);
+    pthread_sigmask(SIG_UNBLOCK, &unblock, NULL);
+#ifdef SLJEX_ENGINE_UNWIND
+    __builtin_longjmp(jb, 1);
+#else
+    longjmp(jb, 1);
+#endif
+}
+
+/**
+    passes a trapped signal raised outside of try blocks to its previous action
+@post
+    calls the previous handler, or for the default (or ignore) action,
+    restores it and returns so the faulting instruction raises the signal again,
+    which ends the process
+@note
+    the trap stays installed for every other fault, the disposition
+    is only changed when the process is about to die from the signal
+*/
+static void trap_chain(size_t i, int sig, siginfo_t * info, void * context) {
+    struct sigaction const * previous = &untrapped[i];
+    if(previous->sa_flags & SA_SIGINFO){
+        previous->sa_sigaction(sig, info, context);
+    }else if(previous->sa_handler != SIG_DFL && previous->sa_handler != SIG_IGN){
+        previous->sa_handler(sig);
+    }else{
+        struct sigaction fatal;
+        fatal.sa_handler = SIG_DFL;
+        fatal.sa_flags = 0;
+        sigemptyset(&fatal.sa_mask);
+        sigaction(sig, &fatal, NULL);
+    }
+}
+
+///locks the registry, used by frames_budget around freeing frame memory
+static void registry_lock(void) {
+    pthread_mutex_lock(&mtx);
+}
+
+///unlocks the registry
+static void registry_unlock(void) {
+    pthread_mutex_unlock(&mtx);
+}
+
+/**
+    internal function passed to vector_init that allocates a new exstate in-place,
+    should not be called manually
+@pre
+    statespace represents an unallocated exstate slot in a vector
+@post
+    statespace is assigned a new valid, allocated exspace instance
+@returns
+    false if fails to initialize, statespace is unchanged
+*/
+bool sljex_exstate_vinit(void * * statespace) {
+    //allocate memory for the new exstate
+    sljex_exstate * sp = malloc(sizeof(sljex_exstate));
+    if(sp == NULL){
+        return false;
+    }
+    //members are reset by exstate_push on every use
+    //assign the new exstate to the reference
+    // and return indicating success
+    *statespace = sp;
+    return true;
+}
+
+/**
+    internal function passed to vector_init that deinitializes an exstate in-place,
+    should not be called manually
+@pre
+    statespace is a valid, allocated exstate instance
+@post
+    statespace's instance will be deallocated
+*/
+static void sljex_exstate_vdeinit(void * * statespace) {
+    free(*statespace);
+}
+
+/**
+    internal function passed to vector_init that allocates a new thread record in-place,
+    should not be called manually
+@pre
+    threadspace represents an unallocated thread record slot in a vector
+@post
+    threadspace is assigned a new valid, allocated thread record
+@returns
+    false if fails to initialize, threadspace is unchanged
+*/
+static bool sljex_thread_vinit(void * * threadspace) {
+    //allocate memory for the record
+    sljex_thread * tp = malloc(sizeof(sljex_thread));
+    //if allocation or initialization fails,
+    // return indicating failure
+    if(tp == NULL){
+        return false;
+    }else if(!vector_init(&tp->frames, sljex_exstate_vinit, sljex_exstate_vdeinit)){
+        free(tp);
+        return false;
+    }
+    vector_setBudget(&tp->frames, &frames_budget);
+    tp->scope = NULL;
+    tp->seq = 0;
+    tp->id = pthread_self();
+    tp->altstack = NULL;
+    tp->terminate = NULL;
+    tp->journal = NULL;
+    tp->journal_gen = 0;
+    tp->arena = NULL;
+    tp->spare = NULL;
+    tp->task = false;
+    tp->txnlog = NULL;
+    tp->txnlen = tp->txncap = 0;
+    tp->txns = 0;
+    *threadspace = tp;
+    return true;
+}
+
+/**
+    internal function passed to vector_init that deinitializes a thread record in-place,
+    should not be called manually
+@pre
+    threadspace is a valid, allocated thread record
+@post
+    threadspace's instance will be deinitialized and deallocated
+*/
+static void sljex_thread_vdeinit(void * * threadspace) {
+    sljex_thread * tp = *threadspace;
+    //the alternate stack can only be uninstalled by its own thread,
+    // another thread's stays installed and must not be freed
+    if(tp->altstack != NULL && pthread_equal(tp->id, pthread_self())){
+        stack_t const disable = {.ss_flags = SS_DISABLE};
+        sigaltstack(&disable, NULL);
+        free(tp->altstack);
+    }else if(tp->altstack != NULL){
+        void * * strays = realloc(stray_altstacks, (stray_count + 1) * sizeof(void *));
+        if(strays != NULL){
+            stray_altstacks = strays;
+            stray_altstacks[stray_count++] = tp->altstack;
+        }
+    }
+    arena_release(tp, NULL, 0);
+    free(tp->spare);
+    free(tp->txnlog);
+    vector_deinit(&tp->frames);
+    free(tp);
 }
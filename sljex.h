@@ -11,37 +11,395 @@ You should have received a copy of the GNU Lesser General Public License along w
 #ifndef SLJEX_H
 #define SLJEX_H
 
+#include <pthread.h>
 #include <setjmp.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 ///Basic exception code defined by default.
 ///All other exception codes must be greater than EXGENERIC.
 #define EXGENERIC 1
 
-///Call before using sljex features to initialize library.
-///Does not add sljex_deinit to atexit and must be called manually.
+#ifdef SLJEX_ENGINE_UNWIND
+//alternative engine, selected by defining SLJEX_ENGINE_UNWIND both for
+// the library (libsljex-unwind) and for the code using it:
+// try only records a landing pad with gcc's lightweight __builtin_setjmp,
+// and throw walks the stack with the table-driven unwinder,
+// running the cleanups (__attribute__((cleanup)), C++ destructors)
+// of the frames it leaves, when they are compiled with -fexceptions
+#define SLJEX_SETJMP_(Buf)\
+    __builtin_setjmp(sljex_landing_(Buf, __builtin_frame_address(0)))
+#define SLJEX_LONGJMP_(Buf)\
+    sljex_unwind_(Buf)
+
+//the engines cannot be mixed, renaming the functions that
+// set up landing pads turns a mismatch into a link error
+#define sljex_trybuf_ sljex_trybuf_unwind_
+#define sljex_deadlinebuf_ sljex_deadlinebuf_unwind_
+#define sljex_cancelbuf_ sljex_cancelbuf_unwind_
+#define sljex_collectbuf_ sljex_collectbuf_unwind_
+#define sljex_recoverbuf_ sljex_recoverbuf_unwind_
+#define sljex_txnbuf_ sljex_txnbuf_unwind_
+
+//word of a landing pad after the ones used by __builtin_setjmp,
+// holds the frame address of the function containing the try
+#define SLJEX_FRAME_SLOT_ 5
+
+//records the frame a landing pad belongs to, so the unwinder
+// knows where to stop
+static inline void * sljex_landing_(void * buf, void * frame) {
+    ((void * *)buf)[SLJEX_FRAME_SLOT_] = frame;
+    return buf;
+}
+
+__attribute__((noreturn)) void sljex_unwind_(void * buf);
+#else
+#define SLJEX_SETJMP_(Buf) setjmp(Buf)
+#define SLJEX_LONGJMP_(Buf) longjmp(Buf, 1)
+#endif
+
+//exception codes thrown by the library itself are negative,
+// so they can never collide with user defined codes
+///Thrown by sljex_checkpoint once the deadline of a sljex_deadline has passed.
+#define EXTIMEOUT (-1)
+///Thrown by sljex_checkpoint once a sljex_cancel_scope has been cancelled.
+#define EXCANCELLED (-2)
+///Thrown at the end of a sljex_collect block that collected any exceptions,
+/// if its collector asked for a summary.
+#define EXCOLLECTED (-3)
+///Thrown for a trapped SIGSEGV (invalid memory access).
+#define EXSEGV (-4)
+///Thrown for a trapped SIGBUS (misaligned access, access past the end of a mapped file).
+#define EXBUS (-5)
+///Thrown for a trapped SIGFPE (integer division by zero).
+#define EXFPE (-6)
+
+///Flags for sljex_trap_signals.
+#define SLJEX_TRAP_SEGV 1
+#define SLJEX_TRAP_BUS 2
+#define SLJEX_TRAP_FPE 4
+
+///Optional, the first try initializes the library on its own.
+///Takes a reference to the library, initializing it if needed,
+/// may be called any number of times from any thread.
+///Returns false if initialization fails.
 bool sljex_initNoCleanup(void);
 
-///Call before using sljex features to initialize library.
-///Also adds sljex_deinit to atexit to deinit library on exit.
+///Same as sljex_initNoCleanup, kept for compatibility.
 bool sljex_init(void);
 
-///Call before program end if library was initialized
-/// with sljex_initNoCleanup, otherwise this is called automatically
-/// at program exit and should not be called manually
+///Releases a reference taken by sljex_init or sljex_initNoCleanup,
+/// the last one deinitializes the library unless a try initialized it first.
+///The library also deinitializes itself when unloaded or at program exit.
 void sljex_deinit(void);
 
 ///Fetches the code of the current exception.
-///Panics if there is no current exception (outside catch/catchany).
+///Must be called inside catch/catchany, libsljex-checked exits with an error
+/// otherwise, while the behavior is undefined with the release build.
 int sljex_excode(void);
 ///Fetches the message of the current exception.
-///Panics if there is no current exception (outside catch/catchany).
+///Must be called inside catch/catchany, libsljex-checked exits with an error
+/// otherwise, while the behavior is undefined with the release build.
 char const * sljex_exstr(void);
+///Fetches the faulting address of the current exception if it is
+/// EXSEGV, EXBUS or EXFPE, NULL otherwise.
+///Must be called inside catch/catchany, libsljex-checked exits with an error
+/// otherwise, while the behavior is undefined with the release build.
+void * sljex_exaddr(void);
+
+///Converts the hardware faults selected by flags (SLJEX_TRAP_ flags)
+/// into exceptions thrown to the innermost try block of the faulting thread.
+///Faults outside of try blocks get the signal's previous action.
+///0 stops trapping. Returns false if a signal handler cannot be installed.
+bool sljex_trap_signals(int flags);
+
+///Identifies the source location of a throw, rethrow or throwWithMsg.
+///One static instance is created by each macro expansion,
+/// so the site pointer itself is the site's id.
+typedef struct sljex_site {
+    char const * file;
+    char const * func;
+    int line;
+    ///profiling data owned by the library, NULL until first profiled
+    void * prof;
+} sljex_site;
+
+///Number of buckets in each sljex_siteprof histogram.
+///Bucket 0 counts zero values, bucket i counts values in [2^(i-1), 2^i),
+/// and the last bucket also counts everything larger.
+#define SLJEX_PROF_BUCKETS 32
+
+///Snapshot of the profiling data collected for one throw site.
+typedef struct sljex_siteprof {
+    ///location of the site, copied by the library when the site is first profiled
+    /// so it stays valid after the module that threw is unloaded
+    char const * file;
+    char const * func;
+    int line;
+    ///exceptions originally thrown from the site
+    unsigned long throws;
+    ///exceptions propagated from the site with rethrow
+    unsigned long rethrows;
+    ///exceptions thrown from the site that were caught and released
+    unsigned long handled;
+    ///sum of try frames each handled exception was delivered to
+    unsigned long long frames_total;
+    ///sum of nanoseconds between throw and catch of each handled exception
+    unsigned long long ns_total;
+    ///histogram of try frames each handled exception was delivered to
+    unsigned long frames[SLJEX_PROF_BUCKETS];
+    ///histogram of nanoseconds between throw and catch
+    unsigned long ns[SLJEX_PROF_BUCKETS];
+} sljex_siteprof;
+
+///Number of innermost frames recorded in a sljex_threadsnap.
+#define SLJEX_SNAPSHOT_FRAMES 16
+
+///One try frame of a sljex_threadsnap.
+typedef struct sljex_framesnap {
+    ///code of the frame's exception, 0 if nothing was thrown to it
+    int excode;
+    ///message of the frame's exception, NULL if nothing was thrown to it
+    char const * exstr;
+    ///whether the exception was caught but not yet released
+    bool caught;
+    ///site the exception was originally thrown from
+    sljex_site const * site;
+} sljex_framesnap;
+
+///Snapshot of the exception stack of one thread.
+typedef struct sljex_threadsnap {
+    pthread_t thread;
+    ///false if the thread kept modifying its stack during every
+    /// attempt at reading it, depth and frames are then empty
+    bool consistent;
+    ///number of active try frames
+    size_t depth;
+    ///number of entries in frames, at most SLJEX_SNAPSHOT_FRAMES
+    size_t count;
+    ///innermost frames, innermost first
+    sljex_framesnap frames[SLJEX_SNAPSHOT_FRAMES];
+} sljex_threadsnap;
+
+///Reads the exception stacks of up to max threads that used try into out,
+/// without blocking them. Returns the total number of such threads.
+size_t sljex_snapshot_all(sljex_threadsnap * out, size_t max);
+
+///Sets how many pops a thread's exception stack must spend below a quarter
+/// of its capacity before the capacity is halved (default 64).
+///0 disables shrinking unless the memory budget is exceeded.
+void sljex_set_shrink_threshold(size_t pops);
+///Sets a soft limit in bytes on the capacity held by all exception stacks.
+///While it is exceeded, stacks shrink without waiting for the threshold.
+///0 removes the limit (default).
+void sljex_set_memory_budget(size_t bytes);
+///Returns the bytes currently held by all exception stacks,
+/// including the try frames retained for reuse.
+size_t sljex_memory_usage(void);
+
+///Enables or disables per-site profiling of throws (disabled by default).
+///Only the throwing path is affected, try and finally cost the same either way.
+void sljex_profile_enable(bool enable);
+///Clears the data collected for every site.
+void sljex_profile_reset(void);
+///Copies up to max site profiles into out, hottest (most throws) first.
+///Returns the total number of profiled sites.
+size_t sljex_profile_report(sljex_siteprof * out, size_t max);
+///Prints a table of up to max of the hottest throw sites to f.
+void sljex_profile_print(FILE * f, size_t max);
+
+///Magic at the start of a journal file.
+#define SLJEX_JOURNAL_MAGIC "SLJEXJNL"
+///Layout version of journal files.
+#define SLJEX_JOURNAL_VERSION 2
+
+///Kinds of sljex_journal_event.
+#define SLJEX_JOURNAL_THROW 1
+#define SLJEX_JOURNAL_RETHROW 2
+#define SLJEX_JOURNAL_UNHANDLED 3
+
+///Header at the start of a journal file, followed by regions regions.
+typedef struct sljex_journal_header {
+    char magic[8];
+    uint32_t version;
+    ///events in each region, the slot at head is being written
+    /// so at most slots - 1 events are complete
+    uint32_t slots;
+    ///number of regions in the file
+    uint32_t regions;
+    ///regions handed out to threads so far, may exceed regions
+    uint32_t claimed;
+} sljex_journal_header;
+
+///Header of the region of one thread, followed by slots events.
+typedef struct sljex_journal_region {
+    ///process and thread that own the region
+    uint64_t pid;
+    uint64_t thread;
+    ///events ever written to the region, event i is in slot i % slots
+    uint64_t head;
+} sljex_journal_region;
+
+///One journaled throw, rethrow or unhandled exception.
+///Strings are copied, truncated to fit.
+typedef struct sljex_journal_event {
+    ///CLOCK_REALTIME of the event in nanoseconds
+    uint64_t ns;
+    ///SLJEX_JOURNAL_ kind
+    int32_t kind;
+    int32_t excode;
+    ///try depth of the thread at the event
+    uint32_t depth;
+    ///line of the throw or rethrow site, the original throw for unhandled exceptions
+    int32_t line;
+    char exstr[40];
+    char file[40];
+    char func[24];
+} sljex_journal_event;
+
+///Starts journaling throws, rethrows and unhandled exceptions into the file at path,
+/// replacing it with room for threads threads of events events each.
+///Events are written to the mapped file with plain stores,
+/// so they survive a crash of the process (but not of the machine).
+///Must not be called while other threads may throw. Returns false on failure.
+bool sljex_journal_open(char const * path, size_t threads, size_t events);
+///Stops journaling and unmaps the file.
+///Must not be called while other threads may throw.
+void sljex_journal_close(void);
+
+///Cancellation flag shared between a sljex_cancel_scope
+/// and the threads that may cancel it.
+typedef struct sljex_cancel {
+    int cancelled;
+} sljex_cancel;
+
+///Initializer for a sljex_cancel that has not been cancelled.
+#define SLJEX_CANCEL_INIT {0}
+
+///Requests cancellation of every scope using token, from any thread.
+void sljex_cancel_request(sljex_cancel * token);
+///Clears a cancellation request so token can be reused.
+void sljex_cancel_reset(sljex_cancel * token);
+///Throws EXTIMEOUT if the deadline of the innermost deadline scope has passed,
+/// or EXCANCELLED if any enclosing cancellation scope has been cancelled.
+///Does nothing outside of scopes, cheap enough to call once per loop iteration.
+void sljex_checkpoint(void);
+
+///One exception recorded by a sljex_collect block.
+typedef struct sljex_collected {
+    int excode;
+    char const * exstr;
+    ///index of the item that threw
+    size_t index;
+} sljex_collected;
+
+///Records the exceptions of a sljex_collect block.
+typedef struct sljex_collector {
+    ///buffer the exceptions are appended to
+    sljex_collected * errors;
+    ///capacity of errors
+    size_t cap;
+    ///number of exceptions thrown, which may exceed cap
+    ///(volatile like index since both change between the setjmp and the longjmp
+    /// of the block, and may be read after the jump)
+    size_t volatile count;
+    ///whether the block throws EXCOLLECTED at its end if anything was collected,
+    /// with the message of the first collected exception
+    bool summary;
+    ///index of the item being processed
+    size_t volatile index;
+    //depth of the block's exception state
+    size_t depth_;
+} sljex_collector;
+
+///Prepares a collector for a sljex_collect block,
+/// errors must have room for cap exceptions.
+void sljex_collector_init(sljex_collector * c, sljex_collected * errors, size_t cap, bool summary);
+
+///Runs the following block for each index I (a new size_t variable) from 0 to N.
+///An exception thrown or rethrown to the block from item I is appended to
+/// the collector pointed to by C, and the loop continues with item I + 1.
+///Only one exception state is set up for the whole loop, so the cost per item
+/// is an index store, and the cost per exception is far less than a catch.
+///The whole loop runs after a single setjmp, so locals of the enclosing function
+/// that the block modifies (e.g. an accumulator) must be volatile to keep their
+/// value once an item throws.
+#define sljex_collect(C, I, N)\
+    for(int sljex_collecting_ = sljex_collect_begin_(C);\
+        sljex_collecting_; sljex_collecting_ = sljex_collect_end_(C))\
+    switch(SLJEX_SETJMP_(sljex_collectbuf_(C))) default:\
+    for(size_t I = (C)->index; I < (N); (C)->index = ++I)
+
+///What a terminate handler wants done with an unhandled exception.
+typedef enum sljex_termaction {
+    ///exit the process, the default without a handler
+    SLJEX_TERMINATE_EXIT,
+    ///deliver the exception to the thread's innermost sljex_recover block,
+    /// exits if there is none
+    SLJEX_TERMINATE_RECOVER
+} sljex_termaction;
+
+///Receives exceptions that no catch handled, in the thread they were thrown in.
+typedef sljex_termaction (*sljex_terminate_handler)(int excode, char const * exstr);
+
+///Sets the terminate handler of threads without their own (NULL to exit).
+///Returns the previous handler.
+sljex_terminate_handler sljex_set_terminate_handler(sljex_terminate_handler handler);
+///Sets the terminate handler of the current thread (NULL to use the global one).
+///Returns the previous handler.
+sljex_terminate_handler sljex_set_thread_terminate_handler(sljex_terminate_handler handler);
+
+///Calls fn(arg) inside a try block of the library, so the caller contains no
+/// setjmp and needs no volatile locals. Returns true if fn returned normally,
+/// otherwise the exception is caught and its code and message are stored
+/// to excode and exstr (either may be NULL).
+bool sljex_try_call(void (*fn)(void * arg), void * arg, int * excode, char const * * exstr);
+
+///Allocates size bytes, aligned for any type, that are freed together when the
+/// frame of the innermost try block is released (by its finally, or by a throw
+/// or rethrow from its catch), so they do not leak when an exception is thrown.
+///Returns NULL outside of try blocks or if memory cannot be allocated.
+void * sljex_scope_alloc(size_t size);
+///Hands the sljex_scope_alloc allocations of the innermost try block
+/// to the enclosing one, so they live until it is released.
+///Returns false if there is no enclosing try block.
+bool sljex_scope_promote(void);
+
+///Marks the start of a task on a (pooled worker) thread, recording its try depth.
+///Tasks do not nest, each sljex_task_begin must be matched by a sljex_task_end.
+void sljex_task_begin(void);
+///Ends the task: the try frames it left behind (e.g. by returning from a catch)
+/// are dropped at once without being handled, and its scope allocations are freed.
+void sljex_task_end(void);
+
+///Records the current size bytes at ptr, to be restored if the
+/// innermost sljex_txn_try block receives an exception.
+///Does nothing outside of sljex_txn_try blocks.
+void sljex_txn_log(void * ptr, size_t size);
+///Records size bytes at ptr like sljex_txn_log, then copies value over them.
+void sljex_txn_write(void * ptr, void const * value, size_t size);
+
+///Entry of a sljex_try_handlers table.
+typedef struct sljex_handler {
+    ///code handled by the entry, 0 handles any exception
+    int excode;
+    ///called with the arg of sljex_try_handlers while the exception is caught,
+    /// so it may use sljex_excode, sljex_exstr and rethrow
+    void (*fn)(void * arg);
+} sljex_handler;
+
+///Calls fn(arg) inside a try block of the library, and passes an exception it throws
+/// to the first of the count entries of table that handles its code.
+///Exceptions no entry handles are rethrown.
+///Returns the code of the handled exception, 0 if fn returned normally.
+int sljex_try_handlers(void (*fn)(void * arg), void * arg, sljex_handler const * table, size_t count);
 
 ///Sets up an exception state to handle exceptions inside the following block.
 ///Must be followed by a finally block.
 #define try\
-    {{{{if(setjmp(sljex_trybuf_()) == 0)
+    {size_t sljex_depth_; {{{if(SLJEX_SETJMP_(sljex_trybuf_(&sljex_depth_)) == 0)
 ///Executes the following block/statement if an exception matching EX is caught.
 ///Must follow a try block if used.
 #define catch(EX)\
@@ -53,25 +411,64 @@ char const * sljex_exstr(void);
 ///cleans up exception state and enforces exception checking.
 ///Must be precluded by a try block.
 #define finally\
-    }}}}sljex_finally_();
+    }}}sljex_finally_(sljex_depth_);}
+///Sets up an exception state like try, which also times out NS nanoseconds later.
+///Nested scopes inherit the deadline of the enclosing scope when it is sooner.
+///Must be followed by a finally block, usually after catch(EXTIMEOUT).
+#define sljex_deadline(NS)\
+    {size_t sljex_depth_; {{{if(SLJEX_SETJMP_(sljex_deadlinebuf_(&sljex_depth_, NS)) == 0)
+///Sets up an exception state like try, which can be cancelled through
+/// the sljex_cancel pointed to by Token, and inherits the enclosing deadline.
+///Must be followed by a finally block, usually after catch(EXCANCELLED).
+#define sljex_cancel_scope(Token)\
+    {size_t sljex_depth_; {{{if(SLJEX_SETJMP_(sljex_cancelbuf_(&sljex_depth_, Token)) == 0)
+///Sets up an exception state like try, which is also a recovery point:
+/// when the terminate handler returns SLJEX_TERMINATE_RECOVER for an exception
+/// that went unhandled inside it, the exception is delivered to its catch blocks.
+///Must be followed by a finally block, usually after catchany.
+#define sljex_recover\
+    {size_t sljex_depth_; {{{if(SLJEX_SETJMP_(sljex_recoverbuf_(&sljex_depth_)) == 0)
+///Sets up an exception state like try, which is also a transaction:
+/// memory logged with sljex_txn_log or sljex_txn_write inside it is restored,
+/// newest first, when an exception is delivered to it (before catch runs).
+///Nested transactions merge into the enclosing one, the outermost
+/// discards its log when it finishes.
+///Must be followed by a finally block.
+#define sljex_txn_try\
+    {size_t sljex_depth_; {{{if(SLJEX_SETJMP_(sljex_txnbuf_(&sljex_depth_)) == 0)
 ///Throws an exception code, using the stringized code as the message.
 #define throw(EX)\
-    longjmp(sljex_throwbuf_(EX, #EX), 1)
+    do{SLJEX_SITE_(sljex_site_);\
+    SLJEX_LONGJMP_(sljex_throwbuf_(EX, #EX, &sljex_site_));}while(0)
 ///Throws an exception code with an explicit message.
 #define throwWithMsg(EX, Message)\
-    longjmp(sljex_throwbuf_(EX, Message), 1)
+    do{SLJEX_SITE_(sljex_site_);\
+    SLJEX_LONGJMP_(sljex_throwbuf_(EX, Message, &sljex_site_));}while(0)
 ///Rethrows the current exception.
 ///Used to explicitly propagate an exception through a try-finally.
-///Panics if there is no current exception (outside catch/catchany).
+///Must be used inside catch/catchany, libsljex-checked exits with an error
+/// otherwise, while the behavior is undefined with the release build.
 #define rethrow\
-    longjmp(sljex_rethrowbuf_(), 1)
+    do{SLJEX_SITE_(sljex_site_);\
+    SLJEX_LONGJMP_(sljex_rethrowbuf_(&sljex_site_));}while(0)
+
+//declares the static site id used by the throwing macros
+#define SLJEX_SITE_(Name)\
+    static sljex_site Name = {__FILE__, __func__, __LINE__, NULL}
 
 //non-user functions wrapped with macros
-void * sljex_trybuf_(void);
+void * sljex_trybuf_(size_t * depth);
+void * sljex_deadlinebuf_(size_t * depth, unsigned long long ns);
+void * sljex_cancelbuf_(size_t * depth, sljex_cancel * token);
 bool sljex_catch_(int excode);
 bool sljex_catchany_(void);
-void sljex_finally_(void);
-void * sljex_throwbuf_(int excode, char const * exstr);
-void * sljex_rethrowbuf_(void);
+void sljex_finally_(size_t depth);
+int sljex_collect_begin_(sljex_collector * c);
+void * sljex_collectbuf_(sljex_collector * c);
+void * sljex_recoverbuf_(size_t * depth);
+void * sljex_txnbuf_(size_t * depth);
+int sljex_collect_end_(sljex_collector * c);
+void * sljex_throwbuf_(int excode, char const * exstr, sljex_site * site);
+void * sljex_rethrowbuf_(sljex_site * site);
 
 #endif
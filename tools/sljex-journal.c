@@ -0,0 +1,88 @@
+//Prints the events of a journal written by sljex_journal_open,
+// e.g. after the process that wrote it crashed or exited unhandled,
+// built by make tools
+//usage: sljex-journal file
+
+#include "../sljex.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char const * kind_name(int32_t kind) {
+    switch(kind){
+    case SLJEX_JOURNAL_THROW:
+        return "throw";
+    case SLJEX_JOURNAL_RETHROW:
+        return "rethrow";
+    case SLJEX_JOURNAL_UNHANDLED:
+        return "UNHANDLED";
+    default:
+        return "?";
+    }
+}
+
+static void print_event(sljex_journal_event const * event) {
+    //fields are printed with a bounded width since the writer
+    // may have crashed before terminating them
+    printf(
+        "  %" PRIu64 ".%09" PRIu64 " %-9s %.40s(%" PRId32 ") depth %" PRIu32 " at %.40s:%" PRId32 " %.24s\n",
+        event->ns / 1000000000u, event->ns % 1000000000u, kind_name(event->kind),
+        event->exstr, event->excode, event->depth, event->file, event->line, event->func
+    );
+}
+
+int main(int argc, char * * argv) {
+    if(argc != 2){
+        fprintf(stderr, "usage: %s file\n", argv[0]);
+        return 2;
+    }
+    FILE * f = fopen(argv[1], "rb");
+    if(f == NULL){
+        perror(argv[1]);
+        return 1;
+    }
+    sljex_journal_header header;
+    if(fread(&header, sizeof(header), 1, f) != 1
+    || memcmp(header.magic, SLJEX_JOURNAL_MAGIC, sizeof(header.magic)) != 0){
+        fprintf(stderr, "%s: not a sljex journal\n", argv[1]);
+        return 1;
+    }else if(header.version != SLJEX_JOURNAL_VERSION){
+        fprintf(stderr, "%s: unsupported journal version %" PRIu32 "\n", argv[1], header.version);
+        return 1;
+    }else if(header.slots < 2 || header.regions == 0){
+        fprintf(stderr, "%s: corrupt journal header\n", argv[1]);
+        return 1;
+    }
+    sljex_journal_event * events = malloc(header.slots * sizeof(sljex_journal_event));
+    if(events == NULL){
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    uint32_t const regions = header.claimed < header.regions ? header.claimed : header.regions;
+    if(header.claimed > header.regions){
+        printf("%" PRIu32 " threads had no region left\n", header.claimed - header.regions);
+    }
+    for(uint32_t r = 0; r < regions; r++){
+        sljex_journal_region region;
+        if(fread(&region, sizeof(region), 1, f) != 1
+        || fread(events, sizeof(sljex_journal_event), header.slots, f) != header.slots){
+            fprintf(stderr, "%s: truncated journal\n", argv[1]);
+            return 1;
+        }
+        //the slot at head may hold an event the writer crashed in the middle of,
+        // so a full ring is shown from the event after it
+        uint64_t const count = region.head < header.slots ? region.head : header.slots - 1;
+        printf(
+            "process %" PRIu64 " thread %" PRIu64 ": %" PRIu64 " events, last %" PRIu64 " kept\n",
+            region.pid, region.thread, region.head, count
+        );
+        for(uint64_t i = region.head - count; i < region.head; i++){
+            print_event(&events[i % header.slots]);
+        }
+    }
+    free(events);
+    fclose(f);
+    return 0;
+}
@@ -17,6 +17,11 @@ You should have received a copy of the GNU Lesser General Public License along w
 ///determines starting size of a vector when initialized with vector_init
 #define VECTOR_INITIAL 5
 
+static bool vector_resize(vector * v, size_t max);
+static void vector_shrinkCheck(vector * v);
+static void vector_budgetAdd(vector * v, size_t bytes);
+static void vector_budgetSub(vector * v, size_t bytes);
+
 /**
     initializes a vector with an optional initializer/deinitializer function
     that can be used by vector_pushInit/vector_popDeinit
@@ -38,10 +43,33 @@ bool vector_init(vector * v, bool(*init)(void * *), void(*deinit)(void * *)) {
     v->max = VECTOR_INITIAL;
     v->init = init;
     v->deinit = deinit;
+    v->budget = NULL;
+    v->lowpops = 0;
+    v->pooled = 0;
 
     return true;
 }
 
+/**
+    attaches a shared budget to a vector,
+    which then shrinks after spending budget->shrinkAfter pops
+    below a quarter of its capacity, or immediately while
+    the budget's limit is exceeded
+@pre
+    v is a reference to an initialized vector,
+    budget outlives v or is NULL
+@post
+    v's capacity is accounted in budget->used
+*/
+void vector_setBudget(vector * v, vector_budget * budget) {
+    assert(v != NULL && v->data != NULL);
+    assert(v->pooled == 0);
+    
+    vector_budgetSub(v, v->max * sizeof(void *));
+    v->budget = budget;
+    vector_budgetAdd(v, v->max * sizeof(void *));
+}
+
 /**
     deinitializes a vector, deinitializing all remaining elements
 @pre
@@ -55,14 +83,19 @@ void vector_deinit(vector * v) {
     //prevent deinit from being called on
     // an already uninitialized vector
     if(v->data != NULL){
-        //if the vector has a deinitializer, deinit all elements
+        //if the vector has a deinitializer, deinit all elements,
+        // including the ones retained for reuse
         if(v->deinit != NULL){
-            for(size_t i = 0; i < v->count; i++){
+            for(size_t i = 0; i < v->pooled; i++){
                 v->deinit(&v->data[i]);
             }
         }
         free(v->data);
         v->data = NULL;
+        if(v->budget != NULL){
+            vector_budgetSub(v, v->max * sizeof(void *) + v->pooled * v->budget->elemSize);
+        }
+        v->count = v->pooled = 0;
     }
 }
 
@@ -79,18 +112,15 @@ void vector_deinit(vector * v) {
 bool vector_push(vector * v, void * p) {
     assert(v != NULL && v->data != NULL);
     assert(p != NULL);
+    assert(v->pooled == v->count);
     
     //grow vector capacity by 2x if full
-    if(v->count == v->max){
-        v->max *= 2;
-        void * tmp = realloc(v->data, v->max * sizeof(void *));
-        if(tmp == NULL){
-            return false;
-        }
-        v->data = tmp;
+    if(v->count == v->max && !vector_resize(v, v->max * 2)){
+        return false;
     }
 
     v->data[v->count++] = p;
+    v->pooled = v->count;
     return true;
 }
 
@@ -108,18 +138,56 @@ bool vector_push(vector * v, void * p) {
 bool vector_pushInit(vector * v) {
     assert(v != NULL && v->data != NULL);
     assert(v->init != NULL);
+    assert(v->pooled == v->count);
     
     //grow vector capacity by 2x if full
-    if(v->count == v->max){
-        v->max *= 2;
-        void * tmp = realloc(v->data, v->max * sizeof(void *));
-        if(tmp == NULL){
-            return false;
-        }
-        v->data = tmp;
+    if(v->count == v->max && !vector_resize(v, v->max * 2)){
+        return false;
+    }
+    
+    if(!v->init(&v->data[v->count])){
+        return false;
     }
+    v->pooled = ++v->count;
+    return true;
+}
 
-    return v->init(&v->data[v->count++]);
+/**
+    add an element to the end of the vector,
+    reusing an element retained by vector_popPooled if there is one,
+    and using the default initializer otherwise
+@pre
+    v is a reference to an initialized vector
+@post
+    v's element count increases by one,
+    reallocating if necessary, and the element is added
+@returns
+    false if reallocation or initializer fails
+@note
+    a reused element is not reinitialized, it is left as it was when popped
+*/
+bool vector_pushPooled(vector * v) {
+    assert(v != NULL && v->data != NULL);
+    
+    if(v->count < v->pooled){
+        v->count++;
+        return true;
+    }
+    
+    assert(v->init != NULL);
+    //grow vector capacity by 2x if full
+    if(v->count == v->max && !vector_resize(v, v->max * 2)){
+        return false;
+    }
+    
+    if(!v->init(&v->data[v->count])){
+        return false;
+    }
+    v->pooled = ++v->count;
+    if(v->budget != NULL){
+        vector_budgetAdd(v, v->budget->elemSize);
+    }
+    return true;
 }
 
 /**
@@ -132,8 +200,65 @@ bool vector_pushInit(vector * v) {
 void vector_pop(vector * v) {
     assert(v != NULL && v->data != NULL);
     assert(v->count > 0);
+    assert(v->pooled == v->count);
+    
+    v->pooled = --v->count;
+    vector_shrinkCheck(v);
+}
+
+/**
+    remove an element from the end of the vector,
+    retaining it for reuse by vector_pushPooled
+@pre
+    v is a reference to an initialized vector
+@post
+    v's element count decreases by one,
+    and the element is kept initialized past the end of the vector
+@note
+    retained elements are deinitialized when the vector
+    shrinks below them or is deinitialized
+*/
+void vector_popPooled(vector * v) {
+    assert(v != NULL && v->data != NULL);
+    assert(v->count > 0);
     
     --v->count;
+    vector_shrinkCheck(v);
+}
+
+/**
+    remove an element from the end of the vector,
+    retaining it for reuse by vector_pushPooled
+@pre
+    v is a reference to an initialized vector
+@post
+    v's element count decreases by one, and the capacity is left as is
+@note
+    does not allocate, free or call the budget's lock,
+    so it may be called from a signal handler
+*/
+void vector_popPooledNoShrink(vector * v) {
+    assert(v != NULL && v->data != NULL);
+    assert(v->count > 0);
+    
+    --v->count;
+}
+
+/**
+    remove the elements past count from the end of the vector,
+    retaining them for reuse by vector_pushPooled
+@pre
+    v is a reference to an initialized vector,
+    count is at most v's element count
+@post
+    v's element count is count, without touching the removed elements
+*/
+void vector_truncatePooled(vector * v, size_t count) {
+    assert(v != NULL && v->data != NULL);
+    assert(count <= v->count);
+    
+    v->count = count;
+    vector_shrinkCheck(v);
 }
 
 /**
@@ -152,8 +277,11 @@ void vector_popDeinit(vector * v) {
     assert(v != NULL && v->data != NULL);
     assert(v->count > 0);
     assert(v->deinit != NULL);
+    assert(v->pooled == v->count);
     
     v->deinit(&v->data[--v->count]);
+    v->pooled = v->count;
+    vector_shrinkCheck(v);
 }
 
 /**
@@ -201,3 +329,93 @@ size_t vector_size(vector * v) {
     
     return v->count;
 }
+
+/**
+    reallocates the element buffer of a vector
+@pre
+    v is a reference to an initialized vector,
+    max is at least the element count of v
+@post
+    v's capacity is max, and its budget is updated
+@returns
+    false if reallocation fails, vector is unchanged
+*/
+static bool vector_resize(vector * v, size_t max) {
+    if(v->budget != NULL && v->budget->lock != NULL){
+        v->budget->lock();
+    }
+    void * tmp = realloc(v->data, max * sizeof(void *));
+    if(tmp != NULL){
+        v->data = tmp;
+    }
+    if(v->budget != NULL && v->budget->unlock != NULL){
+        v->budget->unlock();
+    }
+    if(tmp == NULL){
+        return false;
+    }
+    if(max > v->max){
+        vector_budgetAdd(v, (max - v->max) * sizeof(void *));
+    }else{
+        vector_budgetSub(v, (v->max - max) * sizeof(void *));
+    }
+    v->max = max;
+    return true;
+}
+
+/**
+    halves the capacity of a vector with a budget once it has
+    stayed below a quarter of its capacity for long enough
+@pre
+    v is a reference to an initialized vector
+@post
+    v's capacity may be halved, but never below VECTOR_INITIAL
+@note
+    the hysteresis keeps a stack that oscillates around a
+    power of two from reallocating on every push and pop
+*/
+static void vector_shrinkCheck(vector * v) {
+    if(v->budget == NULL || v->count >= v->max / 4 || v->max <= VECTOR_INITIAL){
+        v->lowpops = 0;
+        return;
+    }
+    size_t const after = __atomic_load_n(&v->budget->shrinkAfter, __ATOMIC_RELAXED);
+    size_t const limit = __atomic_load_n(&v->budget->limit, __ATOMIC_RELAXED);
+    bool const over = limit != 0 && __atomic_load_n(&v->budget->used, __ATOMIC_RELAXED) > limit;
+    if(over || (after != 0 && ++v->lowpops >= after)){
+        size_t const max = v->max / 2 < VECTOR_INITIAL ? VECTOR_INITIAL : v->max / 2;
+        //release the retained elements that no longer fit
+        if(v->pooled > max){
+            if(v->budget->lock != NULL){
+                v->budget->lock();
+            }
+            if(v->deinit != NULL){
+                for(size_t i = max; i < v->pooled; i++){
+                    v->deinit(&v->data[i]);
+                }
+            }
+            vector_budgetSub(v, (v->pooled - max) * v->budget->elemSize);
+            v->pooled = max;
+            if(v->budget->unlock != NULL){
+                v->budget->unlock();
+            }
+        }
+        //a failed shrink leaves the vector usable at its old capacity
+        vector_resize(v, max);
+        v->lowpops = 0;
+    }
+}
+
+///adds bytes to the budget of a vector, if it has one
+static void vector_budgetAdd(vector * v, size_t bytes) {
+    if(v->budget != NULL){
+        __atomic_fetch_add(&v->budget->used, bytes, __ATOMIC_RELAXED);
+    }
+}
+
+///removes bytes from the budget of a vector, if it has one
+static void vector_budgetSub(vector * v, size_t bytes) {
+    if(v->budget != NULL){
+        __atomic_fetch_sub(&v->budget->used, bytes, __ATOMIC_RELAXED);
+    }
+}
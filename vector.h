@@ -16,6 +16,27 @@ You should have received a copy of the GNU Lesser General Public License along w
 #include <stddef.h>
 #include <stdbool.h>
 
+///shrinking policy and capacity accounting shared between vectors
+typedef struct vector_budget {
+    ///pops spent below a quarter of capacity before it is halved,
+    /// 0 only shrinks while the limit is exceeded
+    size_t shrinkAfter;
+    ///bytes of capacity above which vectors shrink without waiting,
+    /// 0 for no limit
+    size_t limit;
+    ///bytes of each element, accounted while initialized
+    /// by vectors using vector_pushPooled
+    size_t elemSize;
+    ///bytes of capacity and pooled elements currently held
+    /// by all vectors using the budget
+    size_t used;
+    ///optional lock taken around freeing or moving memory,
+    /// so other threads can safely read the vectors while holding it
+    void(*lock)(void);
+    ///unlocks what lock locked
+    void(*unlock)(void);
+} vector_budget;
+
 ///a growable stack that stores elements by reference
 typedef struct vector {
     ///element buffer
@@ -28,11 +49,21 @@ typedef struct vector {
     bool(*init)(void * *);
     ///optional deinitializer
     void(*deinit)(void * *);
+    ///optional shrinking policy and capacity accounting
+    vector_budget * budget;
+    ///consecutive pops that left the vector below a quarter of capacity
+    size_t lowpops;
+    ///number of initialized elements, those past count
+    /// are retained for reuse by vector_pushPooled
+    size_t pooled;
 } vector;
 
 ///initialize vector with optional initializer and deinitializer
 bool vector_init(vector * v, bool(*init)(void * *), void(*deinit)(void * *));
 
+///make vector shrink and account its capacity according to a shared budget
+void vector_setBudget(vector * v, vector_budget * budget);
+
 ///deinitializer vector, calling deinitializer on remaining elements if provided
 void vector_deinit(vector * v);
 
@@ -42,9 +73,23 @@ bool vector_push(vector * v, void * p);
 ///push new element to end of vector using initializer
 bool vector_pushInit(vector * v);
 
+///push new element to end of vector, reusing a retained element if there is one,
+/// otherwise using initializer
+bool vector_pushPooled(vector * v);
+
 ///remove element from end of vector
 void vector_pop(vector * v);
 
+///remove element from end of vector, retaining it for reuse by vector_pushPooled
+void vector_popPooled(vector * v);
+
+///remove element from end of vector like vector_popPooled, but never shrink,
+/// so it does not allocate, free or lock (async-signal-safe)
+void vector_popPooledNoShrink(vector * v);
+
+///remove every element past count from the vector, retaining them for reuse by vector_pushPooled
+void vector_truncatePooled(vector * v, size_t count);
+
 ///remove element from end of vector, calling deinitializer if provided
 void vector_popDeinit(vector * v);
 